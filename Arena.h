@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "MemoryTracker.h"
+
+// Bump allocator. Memory comes from a list of blocks that are kept when the arena is rewound, so
+// once an arena has seen its peak usage it never touches the heap again. Individual frees are
+// no-ops; everything allocated after a mark() goes away together on rewind().
+class Arena
+{
+public:
+    typedef struct Marker {
+        size_t block;
+        size_t offset;
+    } Marker;
+
+    explicit Arena(size_t blockSize = 256 * 1024)
+        : blockSize(blockSize)
+        , current(0)
+        , offset(0)
+    {
+    }
+
+    ~Arena()
+    {
+        for (auto& block : blocks) {
+            ::operator delete(block.data);
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        if (size == 0)
+            size = 1;
+        while (true) {
+            if (current < blocks.size()) {
+                const Block& block = blocks[current];
+                const uintptr_t base = reinterpret_cast<uintptr_t>(block.data);
+                const uintptr_t aligned = (base + offset + align - 1) & ~(uintptr_t(align) - 1);
+                if (aligned + size <= base + block.size) {
+                    offset = (aligned - base) + size;
+                    return reinterpret_cast<void*>(aligned);
+                }
+                if (current + 1 < blocks.size() && blocks[current + 1].size >= size + align) {
+                    ++current;
+                    offset = 0;
+                    continue;
+                }
+            }
+            // out of room: put a fresh block right after the current one
+            MemoryTagScope tag(MemoryTag::Arenas);
+            Block block;
+            block.size = std::max(blockSize, size + align);
+            block.data = static_cast<char*>(::operator new(block.size));
+            const size_t at = blocks.empty() ? 0 : current + 1;
+            blocks.insert(blocks.begin() + at, block);
+            current = at;
+            offset = 0;
+        }
+    }
+
+    template<typename T>
+    T* allocateArray(size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+    Marker mark() const { return Marker{ current, offset }; }
+    void rewind(const Marker& marker)
+    {
+        current = marker.block;
+        offset = marker.offset;
+    }
+    void reset() { rewind(Marker{ 0, 0 }); }
+
+    size_t bytesReserved() const
+    {
+        size_t total = 0;
+        for (const auto& block : blocks) {
+            total += block.size;
+        }
+        return total;
+    }
+
+private:
+    typedef struct Block {
+        char* data;
+        size_t size;
+    } Block;
+
+    size_t blockSize;
+    std::vector<Block> blocks;
+    size_t current;
+    size_t offset;
+};
+
+// Rewinds an arena to where it was when the scope was entered.
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena& arena) : arena(arena), marker(arena.mark()) {}
+    ~ArenaScope() { arena.rewind(marker); }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    Arena& arena;
+    Arena::Marker marker;
+};
+
+// Standard allocator on top of an arena, for containers whose lifetime ends before the arena is
+// rewound.
+template<typename T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    ArenaAllocator(Arena& arena) : arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocateArray<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+    Arena* arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Scratch for data that only lives for one frame; the main loop resets it at the start of every
+// frame. Owned by the main thread: allocate before handing work to jobs.
+inline Arena& frameArena()
+{
+    static Arena arena(1024 * 1024);
+    return arena;
+}
+
+// Scratch for level generation, one per thread so levels can be generated in parallel. Generators
+// open an ArenaScope around their temporaries.
+inline Arena& generationArena()
+{
+    static thread_local Arena arena;
+    return arena;
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include "MemoryTracker.h"
+#include "raylib.h"
+
+enum class GameSound { Bump, Win, Danger, Death, Count };
+
+// Where game states send their sounds, so a sim can run without an audio device.
+class AudioSink
+{
+public:
+    virtual ~AudioSink() {}
+
+    virtual void play(GameSound sound) = 0;
+    virtual void stop(GameSound sound) = 0;
+    virtual bool isPlaying(GameSound sound) const = 0;
+    virtual void setVolume(GameSound sound, float volume) = 0;
+};
+
+class NullAudio : public AudioSink
+{
+public:
+    void play(GameSound) override {}
+    void stop(GameSound) override {}
+    bool isPlaying(GameSound) const override { return false; }
+    void setVolume(GameSound, float) override {}
+};
+
+// For a game state simulated on another thread: calls are queued without locking and carried out
+// on the thread that owns the real sink by flush(), which also reports back what is playing. One
+// thread calls the AudioSink methods, one calls flush(). If the queue fills up between flushes the
+// newest calls are dropped.
+class AudioQueue : public AudioSink
+{
+public:
+    AudioQueue()
+        : head(0)
+        , tail(0)
+    {
+        for (int ii = 0; ii < numSounds; ++ii) {
+            playing[ii].store(false, std::memory_order_relaxed);
+        }
+    }
+
+    void play(GameSound sound) override {
+        push({ Op::Play, sound, 0.0f });
+        playing[static_cast<int>(sound)].store(true, std::memory_order_relaxed);
+    }
+    void stop(GameSound sound) override {
+        push({ Op::Stop, sound, 0.0f });
+        playing[static_cast<int>(sound)].store(false, std::memory_order_relaxed);
+    }
+    bool isPlaying(GameSound sound) const override { return playing[static_cast<int>(sound)].load(std::memory_order_relaxed); }
+    void setVolume(GameSound sound, float volume) override { push({ Op::SetVolume, sound, volume }); }
+
+    void flush(AudioSink& target) {
+        const uint32_t end = tail.load(std::memory_order_acquire);
+        uint32_t at = head.load(std::memory_order_relaxed);
+        for (; at != end; ++at) {
+            const Command& command = commands[at % capacity];
+            if (command.op == Op::Play)
+                target.play(command.sound);
+            else if (command.op == Op::Stop)
+                target.stop(command.sound);
+            else
+                target.setVolume(command.sound, command.volume);
+        }
+        head.store(at, std::memory_order_release);
+        for (int ii = 0; ii < numSounds; ++ii) {
+            playing[ii].store(target.isPlaying(static_cast<GameSound>(ii)), std::memory_order_relaxed);
+        }
+    }
+
+private:
+    enum class Op { Play, Stop, SetVolume };
+
+    typedef struct Command {
+        Op op;
+        GameSound sound;
+        float volume;
+    } Command;
+
+    static const int numSounds = static_cast<int>(GameSound::Count);
+    static const uint32_t capacity = 64;
+
+    void push(const Command& command) {
+        const uint32_t at = tail.load(std::memory_order_relaxed);
+        if (at - head.load(std::memory_order_acquire) == capacity)
+            return;
+        commands[at % capacity] = command;
+        tail.store(at + 1, std::memory_order_release);
+    }
+
+    Command commands[capacity];
+    std::atomic<uint32_t> head; // next to flush, advanced by flush()
+    std::atomic<uint32_t> tail; // next free, advanced by the producer
+    std::atomic<bool> playing[numSounds];
+};
+
+// Plays game sounds on a fixed pool of voices, a few for each sound, so a sound can overlap itself
+// instead of cutting itself off. Each sound's file is decoded once and every voice of it is loaded
+// from that. Calls only record what is wanted; update(), once a frame, starts and stops voices and
+// sets their volumes, so a sound asked for many times in a frame, or again within its minInterval,
+// starts once. At most voiceBudget voices play at a time: a sound starting with none to spare takes
+// the voice of the lowest priority sound playing (the oldest, if several), unless that is higher
+// than its own, in which case it is dropped. Create after InitAudioDevice() and destroy before
+// CloseAudioDevice().
+class RaylibAudio : public AudioSink
+{
+public:
+    static const int voiceBudget = 5;
+
+    RaylibAudio()
+        : clock(0.0f)
+        , starts(0)
+    {
+        for (int ii = 0; ii < numSounds; ++ii) {
+            const SoundSpec& spec = specs()[ii];
+            const Wave wave = LoadWave(spec.file);
+            channels[ii] = Channel{ static_cast<int>(voices.size()), spec.voices, 1.0f, false, false, false, -spec.minInterval };
+            for (int vv = 0; vv < spec.voices; ++vv) {
+                voices.push_back(Voice{ trackedLoadSoundFromWave(wave), static_cast<GameSound>(ii), false, 0 });
+            }
+            UnloadWave(wave);
+        }
+    }
+
+    ~RaylibAudio()
+    {
+        for (const Voice& voice : voices) {
+            trackedUnloadSound(voice.sound);
+        }
+    }
+
+    RaylibAudio(const RaylibAudio&) = delete;
+    RaylibAudio& operator=(const RaylibAudio&) = delete;
+
+    void play(GameSound sound) override {
+        Channel& channel = get(sound);
+        if (clock - channel.lastTrigger < specs()[static_cast<int>(sound)].minInterval)
+            return;
+        channel.triggered = true;
+        channel.stopped = false;
+        channel.lastTrigger = clock;
+    }
+    void stop(GameSound sound) override {
+        Channel& channel = get(sound);
+        channel.triggered = false;
+        channel.stopped = true;
+    }
+    // as of the last update(), or about to start
+    bool isPlaying(GameSound sound) const override {
+        const Channel& channel = channels[static_cast<int>(sound)];
+        if (channel.triggered)
+            return true;
+        for (int vv = channel.firstVoice; vv < channel.firstVoice + channel.numVoices; ++vv) {
+            if (voices[vv].playing)
+                return true;
+        }
+        return false;
+    }
+    void setVolume(GameSound sound, float volume) override {
+        Channel& channel = get(sound);
+        if (volume != channel.volume) {
+            channel.volume = volume;
+            channel.volumeChanged = true;
+        }
+    }
+
+    // once a frame, seconds after the last
+    void update(float seconds) {
+        clock += seconds;
+        for (Voice& voice : voices) {
+            if (voice.playing && !IsSoundPlaying(voice.sound))
+                voice.playing = false;
+        }
+        for (int ii = 0; ii < numSounds; ++ii) {
+            Channel& channel = channels[ii];
+            for (int vv = channel.firstVoice; vv < channel.firstVoice + channel.numVoices; ++vv) {
+                if (channel.stopped && voices[vv].playing)
+                    stopVoice(voices[vv]);
+                if (channel.volumeChanged)
+                    SetSoundVolume(voices[vv].sound, channel.volume);
+            }
+            channel.stopped = false;
+            channel.volumeChanged = false;
+        }
+        // the most important first, so they are not the ones left without a voice
+        for (int priority = maxPriority; priority >= 0; --priority) {
+            for (int ii = 0; ii < numSounds; ++ii) {
+                if (channels[ii].triggered && specs()[ii].priority == priority) {
+                    channels[ii].triggered = false;
+                    start(static_cast<GameSound>(ii));
+                }
+            }
+        }
+    }
+
+private:
+    typedef struct SoundSpec {
+        const char* file;
+        int voices;
+        int priority;      // 0 to maxPriority; who gives up a voice to whom
+        float minInterval; // seconds from one start to the next
+    } SoundSpec;
+
+    typedef struct Channel {
+        int firstVoice;
+        int numVoices;
+        float volume;
+        bool volumeChanged;
+        bool triggered; // to start at the next update()
+        bool stopped;   // to stop at the next update()
+        float lastTrigger;
+    } Channel;
+
+    typedef struct Voice {
+        Sound sound;
+        GameSound owner;
+        bool playing;     // as of the last update()
+        uint32_t started; // order of starting, to find the oldest
+    } Voice;
+
+    static const int numSounds = static_cast<int>(GameSound::Count);
+    static const int maxPriority = 3;
+
+    static const SoundSpec* specs() {
+        static const SoundSpec all[numSounds] = {
+            { "Content/hitwall.wav", 4, 0, 0.06f },
+            { "Content/win.wav", 1, 3, 0.0f },
+            { "Content/bg_buzz.wav", 1, 1, 0.0f },
+            { "Content/explosion.wav", 1, 2, 0.0f },
+        };
+        return all;
+    }
+
+    Channel& get(GameSound sound) { return channels[static_cast<int>(sound)]; }
+
+    void start(GameSound sound) {
+        const Channel& channel = get(sound);
+        // a free voice of its own, or else its oldest, which starts over
+        Voice* own = nullptr;
+        for (int vv = channel.firstVoice; vv < channel.firstVoice + channel.numVoices; ++vv) {
+            Voice& candidate = voices[vv];
+            if (!own || (own->playing && (!candidate.playing || candidate.started < own->started)))
+                own = &candidate;
+        }
+        if (!own->playing) {
+            int playing = 0;
+            Voice* victim = nullptr;
+            const int priority = specs()[static_cast<int>(sound)].priority;
+            for (Voice& voice : voices) {
+                if (!voice.playing)
+                    continue;
+                ++playing;
+                const int voicePriority = specs()[static_cast<int>(voice.owner)].priority;
+                if (voicePriority > priority)
+                    continue;
+                const int victimPriority = victim ? specs()[static_cast<int>(victim->owner)].priority : 0;
+                if (!victim || voicePriority < victimPriority || (voicePriority == victimPriority && voice.started < victim->started))
+                    victim = &voice;
+            }
+            if (playing >= voiceBudget) {
+                if (!victim)
+                    return;
+                if (victim->owner == sound)
+                    own = victim; // starts over instead
+                else
+                    stopVoice(*victim);
+            }
+        }
+        PlaySound(own->sound);
+        own->playing = true;
+        own->started = ++starts;
+    }
+
+    void stopVoice(Voice& voice) {
+        StopSound(voice.sound);
+        voice.playing = false;
+    }
+
+    float clock; // seconds of update()s
+    uint32_t starts;
+    Channel channels[numSounds];
+    std::vector<Voice> voices; // each channel's together
+};
@@ -0,0 +1,569 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "MemoryTracker.h"
+#include "raylib.h"
+
+// Where the game draws. Game code draws through canvas() instead of calling raylib itself, so the
+// same frame can go to the window (RaylibCanvas, the default), nowhere (NullCanvas, to time the work
+// before drawing) or into memory (SoftwareCanvas, for image tests and profiling without a GPU).
+// Text is drawn glyph by glyph, laid out with the canvas' own font metrics.
+class Canvas
+{
+public:
+    virtual ~Canvas() {}
+
+    virtual int width() const = 0;
+    virtual int height() const = 0;
+
+    virtual void begin() = 0; // BeginDrawing()
+    virtual void end() = 0;   // EndDrawing()
+    virtual void clear(Color color) = 0;
+
+    // Around the scene, as opposed to text and overlays drawn after it: a canvas may draw it at a
+    // lower resolution and stretch it over itself at endScene(). Coordinates are the canvas' either
+    // way. Only the window does (RaylibCanvas::setSceneScale).
+    virtual void beginScene() {}
+    virtual void endScene() {}
+
+    // vertices counter-clockwise on screen, like DrawTriangle(); the other way round draws nothing
+    virtual void triangle(Vector2 a, Vector2 b, Vector2 c, Color color) = 0;
+    virtual void line(Vector2 a, Vector2 b, Color color) = 0;
+    virtual void circle(Vector2 center, float radius, Color color) = 0;
+    virtual void rectangle(int x, int y, int width, int height, Color color) = 0;
+
+    // text in the default font, as DrawTextCodepoint(), DrawText() and MeasureText()
+    virtual void glyph(int codepoint, Vector2 position, float size, Color color) = 0;
+    virtual void text(const char* str, int x, int y, int size, Color color) = 0;
+    virtual int measureText(const char* str, int size) = 0;
+    virtual float glyphWidth(int codepoint, float size) = 0;
+    virtual int fontBaseSize() = 0;
+};
+
+// The scene goes straight to the window at full scale, and otherwise into the top left of a render
+// texture the size of the window, through a camera zoomed out by the scale, which is then stretched
+// over the window. Changing the scale costs nothing; the texture only changes with the window's size.
+class RaylibCanvas : public Canvas
+{
+public:
+    RaylibCanvas()
+        : sceneScale(1.0f)
+        , inScene(false)
+        , lastPresentMicros(0)
+    {
+        sceneTarget.id = 0;
+    }
+
+    int width() const override { return GetScreenWidth(); }
+    int height() const override { return GetScreenHeight(); }
+
+    void begin() override { BeginDrawing(); }
+    void end() override {
+        const auto start = std::chrono::steady_clock::now();
+        EndDrawing();
+        lastPresentMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+    void clear(Color color) override { ClearBackground(color); }
+
+    void beginScene() override {
+        if (sceneScale >= 1.0f)
+            return;
+        if (sceneTarget.id == 0 || sceneTarget.texture.width != width() || sceneTarget.texture.height != height()) {
+            releaseScene();
+            sceneTarget = trackedLoadRenderTexture(width(), height());
+            SetTextureFilter(sceneTarget.texture, FILTER_BILINEAR);
+        }
+        BeginTextureMode(sceneTarget);
+        Camera2D camera = { { 0.0f, 0.0f }, { 0.0f, 0.0f }, 0.0f, sceneScale };
+        BeginMode2D(camera);
+        inScene = true;
+    }
+
+    void endScene() override {
+        if (!inScene)
+            return;
+        inScene = false;
+        EndMode2D();
+        EndTextureMode();
+        // render textures are upside down, so the part drawn is at the bottom of it, read bottom up
+        const float w = sceneScale * static_cast<float>(sceneTarget.texture.width);
+        const float h = sceneScale * static_cast<float>(sceneTarget.texture.height);
+        const Rectangle source = { 0.0f, static_cast<float>(sceneTarget.texture.height) - h, w, -h };
+        const Rectangle window = { 0.0f, 0.0f, static_cast<float>(width()), static_cast<float>(height()) };
+        DrawTexturePro(sceneTarget.texture, source, window, Vector2{ 0.0f, 0.0f }, 0.0f, WHITE);
+    }
+
+    // the fraction of the window's width and height the scene is drawn at, from the next frame
+    void setSceneScale(float scale) { sceneScale = std::max(0.1f, std::min(1.0f, scale)); }
+    float getSceneScale() const { return sceneScale; }
+
+    // how long the last end() took: waiting for the GPU, the display and the frame limit
+    int64_t presentMicros() const { return lastPresentMicros; }
+
+    // before the window closes; the next scaled scene makes a new texture
+    void releaseScene() {
+        if (sceneTarget.id != 0)
+            trackedUnloadRenderTexture(sceneTarget);
+        sceneTarget.id = 0;
+    }
+
+    void triangle(Vector2 a, Vector2 b, Vector2 c, Color color) override { DrawTriangle(a, b, c, color); }
+    void line(Vector2 a, Vector2 b, Color color) override { DrawLineV(a, b, color); }
+    void circle(Vector2 center, float radius, Color color) override { DrawCircleV(center, radius, color); }
+    void rectangle(int x, int y, int width, int height, Color color) override { DrawRectangle(x, y, width, height, color); }
+
+    void glyph(int codepoint, Vector2 position, float size, Color color) override {
+        DrawTextCodepoint(GetFontDefault(), codepoint, position, size, color);
+    }
+    void text(const char* str, int x, int y, int size, Color color) override { DrawText(str, x, y, size, color); }
+    int measureText(const char* str, int size) override { return MeasureText(str, size); }
+    float glyphWidth(int codepoint, float size) override {
+        const char single[2] = { static_cast<char>(codepoint), '\0' };
+        return MeasureTextEx(GetFontDefault(), single, size, 0.0f).x;
+    }
+    int fontBaseSize() override { return GetFontDefault().baseSize; }
+
+private:
+    RenderTexture2D sceneTarget;
+    float sceneScale;
+    bool inScene;
+    int64_t lastPresentMicros;
+};
+
+// Draws nothing, so everything before the draw calls can be timed on its own.
+class NullCanvas : public Canvas
+{
+public:
+    NullCanvas(int width, int height) : w(width), h(height) {}
+
+    int width() const override { return w; }
+    int height() const override { return h; }
+
+    void begin() override {}
+    void end() override {}
+    void clear(Color) override {}
+    void triangle(Vector2, Vector2, Vector2, Color) override {}
+    void line(Vector2, Vector2, Color) override {}
+    void circle(Vector2, float, Color) override {}
+    void rectangle(int, int, int, int, Color) override {}
+    void glyph(int, Vector2, float, Color) override {}
+    void text(const char*, int, int, int, Color) override {}
+    int measureText(const char* str, int size) override { return static_cast<int>(strlen(str)) * std::max(size, 10) / 2; }
+    float glyphWidth(int, float size) override { return size / 2; }
+    int fontBaseSize() override { return 10; }
+
+private:
+    int w;
+    int h;
+};
+
+// Rasterizes on the CPU into an RGBA framebuffer, blending like raylib's default alpha mode.
+// Triangles cover the pixels whose centers they contain, with ties on shared edges going to exactly
+// one side, so a mesh neither leaves gaps nor blends twice; lines step one pixel at a time along
+// their longer axis. Text uses a built-in 5x7 font laid out in cells of the default font's size
+// (baseSize 10), so positions match the window even though the letters look different.
+//
+// Counts what it drew since begin(), for throughput measurements.
+class SoftwareCanvas : public Canvas
+{
+public:
+    SoftwareCanvas(int width, int height)
+        : w(std::max(1, width))
+        , h(std::max(1, height))
+        , pixels(size_t(w) * h, Color{ 0, 0, 0, 255 })
+        , triangles(0)
+        , lines(0)
+    {
+    }
+
+    int width() const override { return w; }
+    int height() const override { return h; }
+
+    void begin() override {
+        triangles = 0;
+        lines = 0;
+    }
+    void end() override {}
+
+    void clear(Color color) override { std::fill(pixels.begin(), pixels.end(), color); }
+
+    void triangle(Vector2 a, Vector2 b, Vector2 c, Color color) override {
+        ++triangles;
+        // raylib culls triangles that run clockwise on screen
+        const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (!(area < 0.0f))
+            return;
+        // the other way round from here on, so that the inside is on the right of every edge
+        std::swap(b, c);
+        const Edge edges[3] = { Edge(a, b), Edge(b, c), Edge(c, a) };
+        const int y0 = std::max(0, static_cast<int>(floorf(std::min(a.y, std::min(b.y, c.y)))));
+        const int y1 = std::min(h - 1, static_cast<int>(ceilf(std::max(a.y, std::max(b.y, c.y)))));
+        const float xMin = std::max(0.0f, floorf(std::min(a.x, std::min(b.x, c.x))));
+        const float xMax = std::min(static_cast<float>(w - 1), ceilf(std::max(a.x, std::max(b.x, c.x))));
+        for (int y = y0; y <= y1; ++y) {
+            const float py = static_cast<float>(y) + 0.5f;
+            // each edge bounds the row on one side; walk only the span they leave
+            float lo = xMin;
+            float hi = xMax;
+            for (const Edge& edge : edges) {
+                if (edge.dy > 0.0f)
+                    hi = std::min(hi, ceilf(edge.xAt(py) - 0.5f));
+                else if (edge.dy < 0.0f)
+                    lo = std::max(lo, floorf(edge.xAt(py) - 0.5f));
+            }
+            Color* row = &pixels[size_t(y) * w];
+            for (int x = static_cast<int>(lo); x <= static_cast<int>(hi); ++x) {
+                const Vector2 p{ static_cast<float>(x) + 0.5f, py };
+                if (edges[0].covers(p) && edges[1].covers(p) && edges[2].covers(p))
+                    blend(row[x], color);
+            }
+        }
+    }
+
+    void line(Vector2 a, Vector2 b, Color color) override {
+        ++lines;
+        if (!clipToCanvas(a, b))
+            return;
+        const float dx = b.x - a.x;
+        const float dy = b.y - a.y;
+        const int steps = static_cast<int>(ceilf(std::max(fabsf(dx), fabsf(dy))));
+        for (int ii = 0; ii < std::max(steps, 1); ++ii) {
+            const float t = steps ? (static_cast<float>(ii) + 0.5f) / static_cast<float>(steps) : 0.0f;
+            plot(static_cast<int>(floorf(a.x + dx * t)), static_cast<int>(floorf(a.y + dy * t)), color);
+        }
+    }
+
+    void circle(Vector2 center, float radius, Color color) override {
+        const int y0 = std::max(0, static_cast<int>(floorf(center.y - radius)));
+        const int y1 = std::min(h - 1, static_cast<int>(ceilf(center.y + radius)));
+        for (int y = y0; y <= y1; ++y) {
+            const float dy = static_cast<float>(y) + 0.5f - center.y;
+            const float reach = radius * radius - dy * dy;
+            if (reach < 0.0f)
+                continue;
+            const float half = sqrtf(reach);
+            fillSpan(y, center.x - half, center.x + half, color);
+        }
+    }
+
+    void rectangle(int x, int y, int width, int height, Color color) override {
+        for (int yy = std::max(0, y); yy < std::min(h, y + height); ++yy) {
+            for (int xx = std::max(0, x); xx < std::min(w, x + width); ++xx) {
+                blend(pixels[size_t(yy) * w + xx], color);
+            }
+        }
+    }
+
+    void glyph(int codepoint, Vector2 position, float size, Color color) override {
+        if (codepoint < firstGlyph || codepoint > lastGlyph)
+            codepoint = '?';
+        const unsigned char* rows = font()[codepoint - firstGlyph];
+        const float scale = size / static_cast<float>(baseSize);
+        for (int row = 0; row < glyphRows; ++row) {
+            for (int column = 0; column < glyphColumns; ++column) {
+                if (!(rows[row] & (0x10 >> column)))
+                    continue;
+                // the default font leaves a row free above capitals
+                const float x = position.x + static_cast<float>(column) * scale;
+                const float y = position.y + static_cast<float>(row + 1) * scale;
+                for (int yy = static_cast<int>(ceilf(y - 0.5f)); yy < static_cast<int>(ceilf(y + scale - 0.5f)); ++yy) {
+                    fillSpan(yy, x, x + scale, color);
+                }
+            }
+        }
+    }
+
+    void text(const char* str, int x, int y, int size, Color color) override {
+        size = std::max(size, int(baseSize));
+        const float spacing = static_cast<float>(size / baseSize);
+        Vector2 position{ static_cast<float>(x), static_cast<float>(y) };
+        for (const char* ch = str; *ch; ++ch) {
+            if (*ch == '\n') {
+                position.x = static_cast<float>(x);
+                position.y += static_cast<float>(size + size / 2);
+                continue;
+            }
+            glyph(static_cast<unsigned char>(*ch), position, static_cast<float>(size), color);
+            position.x += glyphWidth(*ch, static_cast<float>(size)) + spacing;
+        }
+    }
+
+    int measureText(const char* str, int size) override {
+        size = std::max(size, int(baseSize));
+        const float spacing = static_cast<float>(size / baseSize);
+        float widest = 0.0f;
+        float lineWidth = 0.0f;
+        int lineLength = 0;
+        for (const char* ch = str;; ++ch) {
+            if (*ch == '\n' || !*ch) {
+                widest = std::max(widest, lineWidth + static_cast<float>(std::max(lineLength - 1, 0)) * spacing);
+                if (!*ch)
+                    break;
+                lineWidth = 0.0f;
+                lineLength = 0;
+                continue;
+            }
+            lineWidth += glyphWidth(*ch, static_cast<float>(size));
+            ++lineLength;
+        }
+        return static_cast<int>(widest);
+    }
+
+    float glyphWidth(int, float size) override { return static_cast<float>(glyphColumns) * size / static_cast<float>(baseSize); }
+    int fontBaseSize() override { return baseSize; }
+
+    const Color* data() const { return pixels.data(); }
+    Color pixel(int x, int y) const { return pixels[size_t(y) * w + x]; }
+    long long trianglesDrawn() const { return triangles; }
+    long long linesDrawn() const { return lines; }
+
+    // Saves the framebuffer in any format ExportImage() knows by the extension (.png, .bmp...).
+    bool save(const char* path, std::string& error) const {
+        Image image = GenImageColor(w, h, BLANK); // 32 bit RGBA
+        memcpy(image.data, pixels.data(), pixels.size() * sizeof(Color));
+        ExportImage(image, path);
+        UnloadImage(image);
+        if (!std::ifstream(path)) {
+            error = std::string("cannot write ") + path;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static const int baseSize = 10;
+    static const int glyphColumns = 5;
+    static const int glyphRows = 7;
+    static const int firstGlyph = ' ';
+    static const int lastGlyph = '~';
+
+    // p is inside when it is on the right of a->b as seen on screen. Points exactly on the edge
+    // count if the edge runs down, or left for a horizontal one; a shared edge runs the other way
+    // in the neighbouring triangle, so it takes the points this one leaves.
+    typedef struct Edge {
+        Edge(const Vector2& a, const Vector2& b) : a(a), dx(b.x - a.x), dy(b.y - a.y) {}
+
+        bool covers(const Vector2& p) const {
+            const float side = (p.y - a.y) * dx - (p.x - a.x) * dy;
+            return side > 0.0f || (side == 0.0f && (dy > 0.0f || (dy == 0.0f && dx < 0.0f)));
+        }
+        float xAt(float y) const { return a.x + (y - a.y) * dx / dy; }
+
+        Vector2 a;
+        float dx;
+        float dy;
+    } Edge;
+
+    void plot(int x, int y, Color color) {
+        if (x >= 0 && x < w && y >= 0 && y < h)
+            blend(pixels[size_t(y) * w + x], color);
+    }
+
+    // pixels of row y whose centers lie in [x0, x1)
+    void fillSpan(int y, float x0, float x1, Color color) {
+        if (y < 0 || y >= h)
+            return;
+        const int first = std::max(0, static_cast<int>(ceilf(x0 - 0.5f)));
+        const int last = std::min(w, static_cast<int>(ceilf(x1 - 0.5f)));
+        Color* row = &pixels[size_t(y) * w];
+        for (int x = first; x < last; ++x) {
+            blend(row[x], color);
+        }
+    }
+
+    static void blend(Color& dst, const Color& src) {
+        if (src.a == 255) {
+            dst = src;
+            return;
+        }
+        const int alpha = src.a;
+        const int rest = 255 - alpha;
+        dst.r = static_cast<unsigned char>((src.r * alpha + dst.r * rest + 127) / 255);
+        dst.g = static_cast<unsigned char>((src.g * alpha + dst.g * rest + 127) / 255);
+        dst.b = static_cast<unsigned char>((src.b * alpha + dst.b * rest + 127) / 255);
+        dst.a = static_cast<unsigned char>((src.a * alpha + dst.a * rest + 127) / 255);
+    }
+
+    // Liang-Barsky against the canvas, a pixel of margin either side; false if nothing is left
+    bool clipToCanvas(Vector2& a, Vector2& b) const {
+        const float dx = b.x - a.x;
+        const float dy = b.y - a.y;
+        const float p[4] = { -dx, dx, -dy, dy };
+        const float q[4] = { a.x + 1.0f, static_cast<float>(w) + 1.0f - a.x, a.y + 1.0f, static_cast<float>(h) + 1.0f - a.y };
+        float t0 = 0.0f;
+        float t1 = 1.0f;
+        for (int ii = 0; ii < 4; ++ii) {
+            if (p[ii] == 0.0f) {
+                if (q[ii] < 0.0f)
+                    return false;
+                continue;
+            }
+            const float t = q[ii] / p[ii];
+            if (p[ii] < 0.0f)
+                t0 = std::max(t0, t);
+            else
+                t1 = std::min(t1, t);
+        }
+        if (t0 > t1)
+            return false;
+        const Vector2 start{ a.x + dx * t0, a.y + dy * t0 };
+        b = Vector2{ a.x + dx * t1, a.y + dy * t1 };
+        a = start;
+        return true;
+    }
+
+    // printable ASCII, one byte per row, the leftmost column in bit 4
+    static const unsigned char (*font())[glyphRows] {
+        static const unsigned char glyphs[lastGlyph - firstGlyph + 1][glyphRows] = {
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+        { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // '!'
+        { 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00 }, // '"'
+        { 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a }, // '#'
+        { 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 }, // '$'
+        { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // '%'
+        { 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d }, // '&'
+        { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 }, // '\''
+        { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // '('
+        { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // ')'
+        { 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 }, // '*'
+        { 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 }, // '+'
+        { 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 }, // ','
+        { 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 }, // '-'
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c }, // '.'
+        { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // '/'
+        { 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e }, // '0'
+        { 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e }, // '1'
+        { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f }, // '2'
+        { 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e }, // '3'
+        { 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 }, // '4'
+        { 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e }, // '5'
+        { 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e }, // '6'
+        { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // '7'
+        { 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e }, // '8'
+        { 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c }, // '9'
+        { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 }, // ':'
+        { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 }, // ';'
+        { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // '<'
+        { 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 }, // '='
+        { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // '>'
+        { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // '?'
+        { 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e }, // '@'
+        { 0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // 'A'
+        { 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e }, // 'B'
+        { 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, // 'C'
+        { 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c }, // 'D'
+        { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, // 'E'
+        { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 }, // 'F'
+        { 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, // 'G'
+        { 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // 'H'
+        { 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // 'I'
+        { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // 'J'
+        { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // 'K'
+        { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f }, // 'L'
+        { 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, // 'M'
+        { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // 'N'
+        { 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // 'O'
+        { 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // 'P'
+        { 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, // 'Q'
+        { 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 }, // 'R'
+        { 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, // 'S'
+        { 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // 'T'
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // 'U'
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // 'V'
+        { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, // 'W'
+        { 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 }, // 'X'
+        { 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04, 0x04 }, // 'Y'
+        { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f }, // 'Z'
+        { 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e }, // '['
+        { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // '\\'
+        { 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e }, // ']'
+        { 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 }, // '^'
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f }, // '_'
+        { 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 }, // '`'
+        { 0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f }, // 'a'
+        { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e }, // 'b'
+        { 0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e }, // 'c'
+        { 0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f }, // 'd'
+        { 0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e }, // 'e'
+        { 0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08 }, // 'f'
+        { 0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e }, // 'g'
+        { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 }, // 'h'
+        { 0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e }, // 'i'
+        { 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c }, // 'j'
+        { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 }, // 'k'
+        { 0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // 'l'
+        { 0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11 }, // 'm'
+        { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 }, // 'n'
+        { 0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e }, // 'o'
+        { 0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10 }, // 'p'
+        { 0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01 }, // 'q'
+        { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 }, // 'r'
+        { 0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e }, // 's'
+        { 0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06 }, // 't'
+        { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d }, // 'u'
+        { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // 'v'
+        { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a }, // 'w'
+        { 0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11 }, // 'x'
+        { 0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e }, // 'y'
+        { 0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f }, // 'z'
+        { 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 }, // '{'
+        { 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // '|'
+        { 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 }, // '}'
+        { 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 }, // '~'
+        };
+        return glyphs;
+    }
+
+    int w;
+    int h;
+    std::vector<Color> pixels;
+    long long triangles;
+    long long lines;
+};
+
+inline RaylibCanvas& windowCanvas()
+{
+    static RaylibCanvas window;
+    return window;
+}
+
+// The canvas everything draws to; main thread only. Starts as the window.
+inline Canvas*& currentCanvas()
+{
+    static Canvas* current = &windowCanvas();
+    return current;
+}
+
+inline Canvas& canvas()
+{
+    return *currentCanvas();
+}
+
+// Draws to another canvas until the end of the scope.
+class CanvasScope
+{
+public:
+    explicit CanvasScope(Canvas& target)
+        : previous(currentCanvas())
+    {
+        currentCanvas() = &target;
+    }
+
+    ~CanvasScope()
+    {
+        currentCanvas() = previous;
+    }
+
+    CanvasScope(const CanvasScope&) = delete;
+    CanvasScope& operator=(const CanvasScope&) = delete;
+
+private:
+    Canvas* previous;
+};
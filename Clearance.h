@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// How far every cell of a level is from the nearest wall, for questions that would otherwise sample
+// cells one at a time: how much room there is around a point, whether a box fits, how far a ray
+// travels before it hits something.
+//
+// Distances are chessboard distances in cells (a wall is 0, its eight neighbours 1) with positions
+// wrapping around the slice, one byte a cell, saturating at maxClearance. So every cell within
+// at() - 1 of a cell in either direction is open. Rows outside the level have no walls; they count
+// how far they are from it.
+//
+// build() is a two-pass raster transform, linear in the number of cells: a pass up the slices takes
+// each row from the row before and then along itself both ways, round the seam; a pass down does
+// the same from the other side. The step from the row before is a plain byte loop the compiler
+// vectorizes. update() redoes only the rows an edit can reach, which saturation keeps within
+// maxClearance of it.
+class ClearanceField
+{
+public:
+    typedef std::vector< std::vector< unsigned char > > Grid;
+
+    static const int maxClearance = 63;
+
+    ClearanceField()
+        : numRows(0)
+        , numColumns(0)
+    {
+    }
+
+    void build(const Grid& geom) {
+        numRows = static_cast<int>(geom.size());
+        numColumns = numRows ? static_cast<int>(geom[0].size()) : 0;
+        cells.resize(size_t(numRows) * numColumns);
+        update(geom, 0, numRows - 1);
+    }
+
+    // geom changed in slices [firstSlice, lastSlice]; its size must not have
+    void update(const Grid& geom, int firstSlice, int lastSlice) {
+        if (!numRows)
+            return;
+        const int first = std::max(0, firstSlice - maxClearance);
+        const int last = std::min(numRows - 1, lastSlice + maxClearance);
+        for (int row = first; row <= last; ++row) {
+            unsigned char* out = rowData(row);
+            const unsigned char* in = geom[row].data();
+            for (int column = 0; column < numColumns; ++column) {
+                out[column] = in[column] ? 0 : static_cast<unsigned char>(maxClearance);
+            }
+        }
+        // rows just outside are already final, which is all either pass needs from them
+        for (int row = first; row <= last; ++row) {
+            sweepRow(rowData(row), row > 0 ? rowData(row - 1) : nullptr);
+        }
+        for (int row = last; row >= first; --row) {
+            sweepRow(rowData(row), row + 1 < numRows ? rowData(row + 1) : nullptr);
+        }
+    }
+
+    bool empty() const { return cells.empty(); }
+    int rows() const { return numRows; }
+    int columns() const { return numColumns; }
+
+    int at(int slice, int position) const {
+        if (slice < 0)
+            return std::min(int(maxClearance), -slice);
+        if (slice >= numRows)
+            return std::min(int(maxClearance), slice - numRows + 1);
+        if (position < 0)
+            position += numColumns;
+        else if (position >= numColumns)
+            position -= numColumns;
+        if (position < 0 || position >= numColumns) {
+            position %= numColumns;
+            position = position < 0 ? position + numColumns : position;
+        }
+        return cells[size_t(slice) * numColumns + position];
+    }
+
+    // whether every cell within radius of (slice, position) either way is open
+    bool clearAround(int slice, int position, int radius) const { return at(slice, position) > radius; }
+
+    // Distance from (slice, position) along (sliceDir, positionDir) to the first wall cell, in cells,
+    // or maxDistance if there is none that close. Steps as far as the clearance allows and cell by
+    // cell once it gets close (sphere tracing with boxes).
+    float raycast(float slice, float position, float sliceDir, float positionDir, float maxDistance) const {
+        const float length = sqrtf(sliceDir * sliceDir + positionDir * positionDir);
+        if (!(length > 0.0f))
+            return maxDistance;
+        sliceDir /= length;
+        positionDir /= length;
+        // how far along the ray one cell of chessboard distance is
+        const float perCell = 1.0f / std::max(fabsf(sliceDir), fabsf(positionDir));
+        float travelled = 0.0f;
+        while (travelled < maxDistance) {
+            const float s = slice + sliceDir * travelled;
+            const float p = position + positionDir * travelled;
+            const int cellSlice = static_cast<int>(floorf(s));
+            const int cellPosition = static_cast<int>(floorf(p));
+            const int clearance = at(cellSlice, cellPosition);
+            if (clearance == 0)
+                return travelled;
+            if (clearance > 1) {
+                travelled += static_cast<float>(clearance - 1) * perCell;
+                continue;
+            }
+            // next to a wall: on to the edge of this cell
+            const float toSliceEdge = exitDistance(s - static_cast<float>(cellSlice), sliceDir);
+            const float toPositionEdge = exitDistance(p - static_cast<float>(cellPosition), positionDir);
+            travelled += std::min(toSliceEdge, toPositionEdge) + 1e-4f;
+        }
+        return maxDistance;
+    }
+
+private:
+    unsigned char* rowData(int row) { return &cells[size_t(row) * numColumns]; }
+
+    // along one axis, from offset within a cell to where direction leaves it
+    static float exitDistance(float offset, float direction) {
+        if (direction > 0.0f)
+            return (1.0f - offset) / direction;
+        if (direction < 0.0f)
+            return offset / -direction;
+        return 1e30f;
+    }
+
+    // One row of a pass: the three cells next to each one in the row before, then along the row one
+    // way and back, carrying on round the seam until nothing improves.
+    void sweepRow(unsigned char* row, const unsigned char* before) {
+        const int last = numColumns - 1;
+        if (before && numColumns > 2) {
+            row[0] = std::min(row[0], static_cast<unsigned char>(std::min(before[last], std::min(before[0], before[1])) + 1));
+            for (int column = 1; column < last; ++column) {
+                const unsigned char nearest = std::min(before[column - 1], std::min(before[column], before[column + 1]));
+                row[column] = std::min(row[column], static_cast<unsigned char>(nearest + 1));
+            }
+            row[last] = std::min(row[last], static_cast<unsigned char>(std::min(before[last - 1], std::min(before[last], before[0])) + 1));
+        }
+        for (int column = 1; column <= last; ++column) {
+            row[column] = std::min(row[column], static_cast<unsigned char>(row[column - 1] + 1));
+        }
+        for (int column = 0, from = last; column < last && row[from] + 1 < row[column]; from = column++) {
+            row[column] = static_cast<unsigned char>(row[from] + 1);
+        }
+        for (int column = last - 1; column >= 0; --column) {
+            row[column] = std::min(row[column], static_cast<unsigned char>(row[column + 1] + 1));
+        }
+        for (int column = last, from = 0; column > 0 && row[from] + 1 < row[column]; from = column--) {
+            row[column] = static_cast<unsigned char>(row[from] + 1);
+        }
+    }
+
+    std::vector<unsigned char> cells; // numRows rows of numColumns
+    int numRows;
+    int numColumns;
+};
@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// The cells a shape covers, as rows of bits: bit i of row j is the cell j slices and i positions on
+// from the first one it can touch. A shape is made of whole cells, each a closed unit square, and a
+// unit square at any offset touches the cell it starts in and the next one along either way. So the
+// rows hold the shape spread by a cell both ways, which is right wherever it is placed: a 1x1 box
+// covers 2x2 cells, as the corners collides() used to test did.
+class Footprint
+{
+public:
+    typedef std::vector< std::vector< unsigned char > > Grid;
+
+    static const int maxCells = 63; // either way, so a row with its spread fits in a word
+
+    Footprint()
+        : width(0)
+        , height(0)
+    {
+    }
+
+    // shape[slice][position] is nonzero where the shape is solid; all rows the same length
+    explicit Footprint(const Grid& shape)
+        : height(static_cast<int>(shape.size()))
+    {
+        width = height ? static_cast<int>(shape[0].size()) : 0;
+        assert(width <= maxCells && height <= maxCells);
+        bits.assign(height + 1, 0);
+        for (int slice = 0; slice < height; ++slice) {
+            uint64_t row = 0;
+            for (int position = 0; position < width; ++position) {
+                if (shape[slice][position])
+                    row |= uint64_t(1) << position;
+            }
+            row |= row << 1;
+            bits[slice] |= row;
+            bits[slice + 1] |= row;
+        }
+    }
+
+    // solid, width positions by height slices
+    static Footprint box(int width, int height) {
+        return Footprint(Grid(height, std::vector<unsigned char>(width, 1)));
+    }
+
+    int slices() const { return static_cast<int>(bits.size()); }
+    int positions() const { return width + 1; }
+    uint64_t row(int slice) const { return bits[slice]; }
+
+    // the box round the shape, from its middle
+    float halfWidth() const { return 0.5f * width; }
+    float halfHeight() const { return 0.5f * height; }
+
+    // how far, in chessboard cells, the shape reaches from the cell its middle is in
+    int reach() const { return std::max(width + 1, height + 1) / 2; }
+
+    // the first cell the shape can touch with its middle at (slice, position)
+    int firstSlice(float slice) const { return static_cast<int>(floorf(slice - halfHeight())); }
+    int firstPosition(float position) const { return static_cast<int>(floorf(position - halfWidth())); }
+
+private:
+    std::vector<uint64_t> bits; // slices() rows
+    int width;
+    int height;
+};
+
+// A level's walls packed one bit a cell, twice: a row of bits around every slice, and a column of
+// bits along the level for every position. A box moving in a straight line along either axis ORs
+// together the words of the columns or rows it covers, 64 cells of the way at a time, and scans
+// that for the first wall, so the cost hardly depends on how far it moves or how big it is.
+class CollisionMask
+{
+public:
+    typedef std::vector< std::vector< unsigned char > > Grid;
+
+    static const int none = -1;
+    static const int anyWall = 0; // build() from every nonzero cell
+
+    CollisionMask()
+        : numSlices(0)
+        , sliceSize(0)
+        , rowWords(0)
+        , columnWords(0)
+        , cellValue(anyWall)
+    {
+    }
+
+    // the walls of geom: its cells holding value, or all its nonzero ones
+    void build(const Grid& geom, int value = anyWall) {
+        cellValue = value;
+        numSlices = static_cast<int>(geom.size());
+        sliceSize = numSlices ? static_cast<int>(geom[0].size()) : 0;
+        rowWords = (sliceSize + 63) / 64;
+        columnWords = (numSlices + 63) / 64;
+        rows.assign(size_t(numSlices) * rowWords, 0);
+        columns.assign(size_t(sliceSize) * columnWords, 0);
+        update(geom, 0, numSlices - 1);
+    }
+
+    // geom changed in slices [firstSlice, lastSlice]; its size must not have
+    void update(const Grid& geom, int firstSlice, int lastSlice) {
+        firstSlice = std::max(0, firstSlice);
+        lastSlice = std::min(numSlices - 1, lastSlice);
+        for (int slice = firstSlice; slice <= lastSlice; ++slice) {
+            uint64_t* row = &rows[size_t(slice) * rowWords];
+            std::fill(row, row + rowWords, uint64_t(0));
+            const uint64_t sliceBit = uint64_t(1) << (slice & 63);
+            for (int position = 0; position < sliceSize; ++position) {
+                uint64_t& columnWord = columns[size_t(position) * columnWords + (slice >> 6)];
+                const int cell = geom[slice][position];
+                if (cellValue == anyWall ? cell != 0 : cell == cellValue) {
+                    row[position >> 6] |= uint64_t(1) << (position & 63);
+                    columnWord |= sliceBit;
+                }
+                else {
+                    columnWord &= ~sliceBit;
+                }
+            }
+        }
+    }
+
+    bool wall(int slice, int position) const {
+        if (slice < 0 || slice >= numSlices)
+            return false;
+        position = wrap(position);
+        return (rows[size_t(slice) * rowWords + (position >> 6)] >> (position & 63)) & 1;
+    }
+
+    // Whether footprint, from (firstSlice, firstPosition) on, covers a wall: a word from each row it
+    // covers, round the seam, against the footprint's row. Slices outside the level have no walls.
+    bool overlaps(const Footprint& footprint, int firstSlice, int firstPosition) const {
+        const int begin = std::max(firstSlice, 0);
+        const int end = std::min(firstSlice + footprint.slices(), numSlices);
+        for (int slice = begin; slice < end; ++slice) {
+            if (rowBits(slice, firstPosition, footprint.positions()) & footprint.row(slice - firstSlice))
+                return true;
+        }
+        return false;
+    }
+
+    // whether any cell of slices [firstSlice, lastSlice] and count (up to 64) positions from
+    // firstPosition on is a wall
+    bool boxHasWall(int firstSlice, int lastSlice, int firstPosition, int count) const {
+        const int begin = std::max(firstSlice, 0);
+        const int end = std::min(lastSlice + 1, numSlices);
+        for (int slice = begin; slice < end; ++slice) {
+            if (rowBits(slice, firstPosition, count))
+                return true;
+        }
+        return false;
+    }
+
+    // The slice nearest to from, going towards to (either way, both included), where any of count
+    // (up to 64) positions from firstPosition on, round the seam, is a wall; or none. Slices outside
+    // the level have no walls.
+    int firstSliceWithWall(int firstPosition, int count, int from, int to) const {
+        const int step = from <= to ? 1 : -1;
+        const int begin = std::max(std::min(from, to), 0);
+        const int end = std::min(std::max(from, to), numSlices - 1) + 1;
+        if (begin >= end)
+            return none;
+        const int firstColumn = wrap(firstPosition);
+        for (int word = (step > 0 ? begin : end - 1) >> 6; word >= begin >> 6 && word <= (end - 1) >> 6; word += step) {
+            uint64_t cells = 0;
+            for (int ii = 0, column = firstColumn; ii < count; ++ii, column = column + 1 < sliceSize ? column + 1 : 0) {
+                cells |= columns[size_t(column) * columnWords + word];
+            }
+            cells &= wordMask(word, begin, end);
+            if (cells)
+                return word * 64 + (step > 0 ? lowestBit(cells) : highestBit(cells));
+        }
+        return none;
+    }
+
+    // How many positions after start (going up, or down if count is negative) the first wall in any
+    // of slices [firstSlice, lastSlice] is, within |count| positions and wrapping round the slice;
+    // none if there is none. Slices outside the level have no walls.
+    int stepsToWall(int firstSlice, int lastSlice, int start, int count) const {
+        firstSlice = std::max(firstSlice, 0);
+        lastSlice = std::min(lastSlice, numSlices - 1);
+        if (firstSlice > lastSlice || count == 0)
+            return none;
+        const int length = std::min(count < 0 ? -count : count, sliceSize);
+        for (int done = 0; done < length; done += 64) {
+            const int n = std::min(64, length - done);
+            // the n positions after the done already looked at, lowest first
+            const int first = count > 0 ? start + 1 + done : start - done - n;
+            const Window window = this->window(first, n);
+            uint64_t cells = 0;
+            for (int slice = firstSlice; slice <= lastSlice; ++slice) {
+                cells |= bits(slice, window);
+            }
+            if (cells)
+                return count > 0 ? done + lowestBit(cells) + 1 : done + n - highestBit(cells);
+        }
+        return none;
+    }
+
+private:
+    int wrap(int position) const {
+        // nearly always within a lap either way, which spares a division
+        if (position < 0)
+            position += sliceSize;
+        else if (position >= sliceSize)
+            position -= sliceSize;
+        if (position < 0 || position >= sliceSize) {
+            position %= sliceSize;
+            position = position < 0 ? position + sliceSize : position;
+        }
+        return position;
+    }
+
+    static int lowestBit(uint64_t bits) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanForward(&index, static_cast<unsigned long>(bits)))
+            return static_cast<int>(index);
+        _BitScanForward(&index, static_cast<unsigned long>(bits >> 32));
+        return static_cast<int>(index) + 32;
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+    static int highestBit(uint64_t bits) {
+#if defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanReverse(&index, static_cast<unsigned long>(bits >> 32)))
+            return static_cast<int>(index) + 32;
+        _BitScanReverse(&index, static_cast<unsigned long>(bits));
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(bits);
+#endif
+    }
+
+    // bits set from begin (included) up to end (not), as a mask of one word
+    static uint64_t wordMask(int word, int begin, int end) {
+        const int from = std::max(begin - word * 64, 0);
+        const int to = std::min(end - word * 64, 64);
+        const uint64_t high = to == 64 ? ~uint64_t(0) : (uint64_t(1) << to) - 1;
+        return high & (~uint64_t(0) << from);
+    }
+
+    // the walls of count (up to 64) positions of slice from firstPosition on, round the seam
+    uint64_t rowBits(int slice, int firstPosition, int count) const {
+        const uint64_t* row = &rows[size_t(slice) * rowWords];
+        firstPosition = wrap(firstPosition);
+        const int firstPart = std::min(count, sliceSize - firstPosition);
+        uint64_t cells = extract(row, firstPosition, firstPart);
+        if (firstPart < count)
+            cells |= extract(row, 0, count - firstPart) << firstPart;
+        return cells;
+    }
+
+    // Where count (up to 64) positions from firstPosition on are in any row, round the seam: up to
+    // two runs of bits, each from a word or two, worked out once to take from many rows.
+    typedef struct Window {
+        int word;        // of the first run
+        int shift;
+        uint64_t mask;   // of the first run's bits, once shifted down
+        int firstCount;
+        int secondCount; // bits of the second run, from position 0, which go above the first
+    } Window;
+
+    Window window(int firstPosition, int count) const {
+        firstPosition = wrap(firstPosition);
+        const int firstPart = std::min(count, sliceSize - firstPosition);
+        return Window{ firstPosition >> 6, firstPosition & 63, firstPart == 64 ? ~uint64_t(0) : (uint64_t(1) << firstPart) - 1, firstPart, count - firstPart };
+    }
+
+    uint64_t bits(int slice, const Window& window) const {
+        const uint64_t* row = &rows[size_t(slice) * rowWords];
+        uint64_t cells = row[window.word] >> window.shift;
+        // the word after holds the rest of the run, if it goes on past this one
+        if (window.shift && window.word + 1 < rowWords)
+            cells |= row[window.word + 1] << (64 - window.shift);
+        cells &= window.mask;
+        if (window.secondCount)
+            cells |= extract(row, 0, window.secondCount) << window.firstCount;
+        return cells;
+    }
+
+    // count (up to 64) bits from begin on, which must all be in the row
+    static uint64_t extract(const uint64_t* words, int begin, int count) {
+        const int word = begin >> 6;
+        const int shift = begin & 63;
+        uint64_t bits = words[word] >> shift;
+        if (shift && shift + count > 64)
+            bits |= words[word + 1] << (64 - shift);
+        return count == 64 ? bits : bits & ((uint64_t(1) << count) - 1);
+    }
+
+    std::vector<uint64_t> rows;    // numSlices rows of rowWords
+    std::vector<uint64_t> columns; // sliceSize columns of columnWords
+    int numSlices;
+    int sliceSize;
+    int rowWords;
+    int columnWords;
+    int cellValue;
+};
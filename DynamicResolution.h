@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Picks the fraction of the window's width and height the scene is drawn at, to keep frames within a
+// budget. It looks at frames in windows of windowFrames: how long they took, and how much of that
+// was spent presenting (waiting for the GPU, the display and the frame limit) rather than on the CPU.
+//
+// Filling pixels is what the scale saves, and that goes with the area drawn, so a window over budget
+// scales down by the square root of how far over it is. A window over budget on the CPU alone leaves
+// the scale where it is, as drawing less would not help. There is no telling from frame times alone
+// how much headroom a frame that made the budget had, so after probeFrames within budget the scale
+// tries a step back up; if that step goes over, it drops back and waits twice as long before trying
+// again. Scales are multiples of scaleStep, so they are few and each change is worth logging.
+class DynamicResolution
+{
+public:
+    static const int windowFrames = 15;
+    static const int firstProbeFrames = 120;
+    static const int maxProbeFrames = 120 * 16;
+
+    DynamicResolution(int64_t budgetMicros, float minScale = 0.5f)
+        : budgetMicros(budgetMicros)
+        , minScale(minScale)
+        , currentScale(1.0f)
+        , probeFrames(firstProbeFrames)
+        , framesWithinBudget(0)
+        , probing(false)
+        , frames(0)
+        , frameSum(0)
+        , cpuSum(0)
+        , lastFrameMicros(0)
+        , lastCpuMicros(0)
+    {
+    }
+
+    float scale() const { return currentScale; }
+
+    // means over the last window, for logging a change
+    int64_t recentFrameMicros() const { return lastFrameMicros; }
+    int64_t recentCpuMicros() const { return lastCpuMicros; }
+
+    // a frame that took frameMicros, presentMicros of it presenting; true if scale() changed
+    bool update(int64_t frameMicros, int64_t presentMicros) {
+        frameSum += frameMicros;
+        cpuSum += std::max(int64_t(0), frameMicros - presentMicros);
+        if (++frames < windowFrames)
+            return false;
+        lastFrameMicros = frameSum / frames;
+        lastCpuMicros = cpuSum / frames;
+        frames = 0;
+        frameSum = 0;
+        cpuSum = 0;
+
+        const float previous = currentScale;
+        if (lastFrameMicros * 10 > budgetMicros * 11) {
+            framesWithinBudget = 0;
+            if (probing) {
+                // the last step up was one too many
+                probing = false;
+                probeFrames = std::min(probeFrames * 2, int(maxProbeFrames));
+                currentScale = roundDown(currentScale - scaleStep);
+            }
+            else if (lastCpuMicros < budgetMicros) {
+                const float area = static_cast<float>(budgetMicros) / static_cast<float>(lastFrameMicros);
+                currentScale = roundDown(currentScale * std::sqrt(area));
+            }
+            return currentScale != previous;
+        }
+        framesWithinBudget += windowFrames;
+        if (framesWithinBudget >= probeFrames) {
+            if (probing)
+                probeFrames = firstProbeFrames; // the last step up held
+            framesWithinBudget = 0;
+            probing = currentScale < 1.0f;
+            if (probing)
+                currentScale = roundDown(currentScale + scaleStep);
+        }
+        return currentScale != previous;
+    }
+
+private:
+    static constexpr float scaleStep = 0.05f;
+
+    // the multiple of scaleStep at or below scale, within [minScale, 1]
+    float roundDown(float scale) const {
+        const float steps = std::floor(scale / scaleStep + 1e-3f);
+        return std::max(minScale, std::min(1.0f, steps * scaleStep));
+    }
+
+    int64_t budgetMicros;
+    float minScale;
+    float currentScale;
+    int probeFrames;        // within budget before the next step up
+    int framesWithinBudget; // since the last change or step up
+    bool probing;           // stepped up, and not yet within budget for probeFrames since
+    int frames;             // in the current window
+    int64_t frameSum;
+    int64_t cpuSum;
+    int64_t lastFrameMicros;
+    int64_t lastCpuMicros;
+};
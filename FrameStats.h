@@ -0,0 +1,218 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+// Counts of durations in microseconds, in log-linear buckets: exact up to 32 us, then 16 buckets
+// per power of two, so a percentile read back is within about 6% of the real one. Fixed size; it
+// never allocates, whatever it records.
+class LogHistogram
+{
+public:
+    LogHistogram() { reset(); }
+
+    void reset() {
+        std::fill(counts, counts + numBuckets, 0u);
+        total = 0;
+        sum = 0;
+        largest = 0;
+    }
+
+    void record(int64_t micros) {
+        const int64_t top = maxValue;
+        const uint64_t value = static_cast<uint64_t>(std::max(int64_t(0), std::min(micros, top)));
+        ++counts[bucketOf(value)];
+        ++total;
+        sum += value;
+        largest = std::max(largest, value);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return largest; }
+    double mean() const { return total ? static_cast<double>(sum) / static_cast<double>(total) : 0.0; }
+
+    // the value fraction of the recorded ones are at or below, to bucket precision
+    uint64_t percentile(double fraction) const {
+        if (!total)
+            return 0;
+        const uint64_t rank = std::max(uint64_t(1), static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total))));
+        uint64_t seen = 0;
+        for (int ii = 0; ii < numBuckets; ++ii) {
+            seen += counts[ii];
+            if (seen >= rank)
+                return std::min(bucketTop(ii), largest);
+        }
+        return largest;
+    }
+
+private:
+    static const int subBits = 4;
+    static const int subBuckets = 1 << subBits;
+    static const int valueBits = 32; // a bit over an hour
+    static const int numBuckets = (valueBits + 1 - subBits) * subBuckets;
+    static const int64_t maxValue = (int64_t(1) << valueBits) - 1;
+
+    // values below 2 * subBuckets get a bucket each; above that, the top subBits + 1 bits pick it
+    static int bucketOf(uint64_t value) {
+        int exponent = 0;
+        while ((value >> exponent) >= uint64_t(2 * subBuckets)) {
+            ++exponent;
+        }
+        return exponent * subBuckets + static_cast<int>(value >> exponent);
+    }
+
+    static uint64_t bucketTop(int bucket) {
+        if (bucket < 2 * subBuckets)
+            return static_cast<uint64_t>(bucket);
+        const int exponent = bucket / subBuckets - 1;
+        const uint64_t mantissa = static_cast<uint64_t>(bucket - exponent * subBuckets);
+        return ((mantissa + 1) << exponent) - 1;
+    }
+
+    uint32_t counts[numBuckets];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t largest;
+};
+
+// Frame, sim and render times of a session, with a histogram of each for every part of the game
+// (title, each level, death, win) and the slowest frames kept aside, written out as a text report
+// at the end. Sections are named by the caller; past maxSections everything lands in the last one.
+class FrameStats
+{
+public:
+    static const int maxSections = 12;
+    static const int maxWorstFrames = 10;
+
+    FrameStats()
+        : numSections(0)
+        , numWorstFrames(0)
+    {
+    }
+
+    // Times in microseconds; pass a negative time for one that was not measured. frameMicros picks
+    // the worst frames, or simMicros when there is no frame time (headless).
+    void record(const char* section, int frame, int tick, int64_t frameMicros, int64_t simMicros, int64_t renderMicros) {
+        Section& into = findSection(section);
+        if (frameMicros >= 0) into.frame.record(frameMicros);
+        if (simMicros >= 0) into.sim.record(simMicros);
+        if (renderMicros >= 0) into.render.record(renderMicros);
+
+        // kept slowest first
+        const int64_t cost = frameMicros >= 0 ? frameMicros : simMicros;
+        const int capacity = maxWorstFrames;
+        int slot = numWorstFrames;
+        while (slot > 0 && worstFrames[slot - 1].cost < cost) {
+            --slot;
+        }
+        if (slot == capacity)
+            return;
+        numWorstFrames = std::min(numWorstFrames + 1, capacity);
+        for (int ii = numWorstFrames - 1; ii > slot; --ii) {
+            worstFrames[ii] = worstFrames[ii - 1];
+        }
+        WorstFrame& worst = worstFrames[slot];
+        copyName(worst.section, into.name);
+        worst.frame = frame;
+        worst.tick = tick;
+        worst.cost = cost;
+        worst.frameMicros = frameMicros;
+        worst.simMicros = simMicros;
+        worst.renderMicros = renderMicros;
+    }
+
+    // all times in microseconds
+    void print(std::ostream& out, const std::string& heading) const {
+        char line[160];
+        out << heading << "\n\n";
+        snprintf(line, sizeof(line), "%-12s %-7s %8s %9s %9s %9s %9s %9s\n", "section", "time", "count", "mean", "p50", "p90", "p99", "max");
+        out << line;
+        for (int ss = 0; ss < numSections; ++ss) {
+            const Section& section = sections[ss];
+            const LogHistogram* histograms[] = { &section.frame, &section.sim, &section.render };
+            const char* names[] = { "frame", "sim", "render" };
+            for (int hh = 0; hh < 3; ++hh) {
+                const LogHistogram& histogram = *histograms[hh];
+                if (!histogram.count())
+                    continue;
+                snprintf(line, sizeof(line), "%-12.23s %-7s %8llu %9.1f %9llu %9llu %9llu %9llu\n", section.name, names[hh],
+                    static_cast<unsigned long long>(histogram.count()), histogram.mean(),
+                    static_cast<unsigned long long>(histogram.percentile(0.5)), static_cast<unsigned long long>(histogram.percentile(0.9)),
+                    static_cast<unsigned long long>(histogram.percentile(0.99)), static_cast<unsigned long long>(histogram.max()));
+                out << line;
+            }
+        }
+
+        out << "\nworst frames\n";
+        for (int ii = 0; ii < numWorstFrames; ++ii) {
+            const WorstFrame& worst = worstFrames[ii];
+            snprintf(line, sizeof(line), "%9lld  %-12.23s frame %d, tick %d", static_cast<long long>(worst.cost), worst.section, worst.frame, worst.tick);
+            out << line;
+            if (worst.frameMicros >= 0 && worst.simMicros >= 0) {
+                snprintf(line, sizeof(line), ", sim %lld", static_cast<long long>(worst.simMicros));
+                out << line;
+            }
+            if (worst.renderMicros >= 0) {
+                snprintf(line, sizeof(line), ", render %lld", static_cast<long long>(worst.renderMicros));
+                out << line;
+            }
+            out << "\n";
+        }
+    }
+
+    bool save(const char* path, const std::string& heading, std::string& error) const {
+        std::ofstream file(path);
+        if (file)
+            print(file, heading);
+        if (!file) {
+            error = std::string("cannot write ") + path;
+            return false;
+        }
+        return true;
+    }
+
+private:
+    typedef struct Section {
+        char name[24];
+        LogHistogram frame;
+        LogHistogram sim;
+        LogHistogram render;
+    } Section;
+
+    typedef struct WorstFrame {
+        char section[24];
+        int frame;
+        int tick;
+        int64_t cost;
+        int64_t frameMicros;
+        int64_t simMicros;
+        int64_t renderMicros;
+    } WorstFrame;
+
+    static void copyName(char (&to)[24], const char* from) {
+        snprintf(to, sizeof(to), "%s", from);
+    }
+
+    Section& findSection(const char* name) {
+        for (int ss = 0; ss < numSections; ++ss) {
+            if (strncmp(sections[ss].name, name, sizeof(sections[ss].name) - 1) == 0)
+                return sections[ss];
+        }
+        if (numSections == maxSections)
+            return sections[maxSections - 1];
+        Section& added = sections[numSections++];
+        copyName(added.name, name);
+        return added;
+    }
+
+    Section sections[maxSections];
+    int numSections;
+    WorstFrame worstFrames[maxWorstFrames];
+    int numWorstFrames;
+};
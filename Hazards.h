@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <assert.h>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Clearance.h"
+#include "CollisionMask.h"
+
+// Fixed capacity structure-of-arrays pool of moving hazards.
+//
+// A hazard is a box in sim space (slice, position round the perimeter) with a velocity and a half
+// extent along either axis. Like the player it is a closed box: it covers every cell from
+// floor(centre - half) to floor(centre + half) each way. Live hazards are packed in [0, size()), and
+// remove() moves the last one into the gap, so the systems below always run over dense arrays.
+class HazardPool
+{
+public:
+    static const int maxHalfCells = 31; // so a hazard is at most 64 cells across
+
+    HazardPool(int capacity, int perimeter)
+        : count(0)
+        , maxCount(capacity)
+        , perimeter(perimeter)
+        , slice(new float[capacity])
+        , position(new float[capacity])
+        , sliceVel(new float[capacity])
+        , positionVel(new float[capacity])
+        , halfSlices(new float[capacity])
+        , halfPositions(new float[capacity])
+        , kind(new uint8_t[capacity])
+    {
+    }
+
+    HazardPool(const HazardPool&) = delete;
+    HazardPool& operator=(const HazardPool&) = delete;
+
+    int size() const { return count; }
+    int capacity() const { return maxCount; }
+    void clear() { count = 0; }
+
+    // returns false when the pool is full; a hazard moves at most a cell a tick either way
+    bool spawn(float atSlice, float atPosition, float velSlices, float velPositions, float halfS, float halfP, int hazardKind) {
+        if (count == maxCount)
+            return false;
+        assert(halfS <= maxHalfCells && halfP <= maxHalfCells);
+        assert(fabsf(velSlices) <= 1.0f && fabsf(velPositions) <= 1.0f);
+        const int ii = count++;
+        slice[ii] = atSlice;
+        position[ii] = wrap(atPosition);
+        sliceVel[ii] = velSlices;
+        positionVel[ii] = velPositions;
+        halfSlices[ii] = halfS;
+        halfPositions[ii] = halfP;
+        kind[ii] = static_cast<uint8_t>(hazardKind);
+        return true;
+    }
+
+    void remove(int ii) {
+        const int last = --count;
+        slice[ii] = slice[last];
+        position[ii] = position[last];
+        sliceVel[ii] = sliceVel[last];
+        positionVel[ii] = positionVel[last];
+        halfSlices[ii] = halfSlices[last];
+        halfPositions[ii] = halfPositions[last];
+        kind[ii] = kind[last];
+    }
+
+    // One tick for hazards [begin, end): each moves along the slices and then round the perimeter,
+    // and turns back along an axis instead where the move would put its box on a wall. The walls are
+    // those of walls, which are always there, and of phaseWalls[group] for each bit group set in
+    // solidPhases, as the level's anyWallMask() has them. Hazards with nothing in reach, going by the
+    // level's clearance, skip the wall tests. Hazards only read the level and write their own
+    // entries, so ranges can run on different jobs.
+    void step(const ClearanceField& clearance, const CollisionMask& walls, const CollisionMask* phaseWalls, uint32_t solidPhases, int begin, int end) {
+        for (int ii = begin; ii < end; ++ii) {
+            const int reach = static_cast<int>(ceilf(std::max(halfSlices[ii], halfPositions[ii]))) + 1;
+            if (clearance.at(static_cast<int>(floorf(slice[ii])), static_cast<int>(floorf(position[ii]))) > reach) {
+                slice[ii] += sliceVel[ii];
+                position[ii] = wrap(position[ii] + positionVel[ii]);
+                continue;
+            }
+            const float nextSlice = slice[ii] + sliceVel[ii];
+            if (boxHasWall(walls, phaseWalls, solidPhases, nextSlice, position[ii], halfSlices[ii], halfPositions[ii]))
+                sliceVel[ii] = -sliceVel[ii];
+            else
+                slice[ii] = nextSlice;
+            const float nextPosition = wrap(position[ii] + positionVel[ii]);
+            if (boxHasWall(walls, phaseWalls, solidPhases, slice[ii], nextPosition, halfSlices[ii], halfPositions[ii]))
+                positionVel[ii] = -positionVel[ii];
+            else
+                position[ii] = nextPosition;
+        }
+    }
+    void step(const ClearanceField& clearance, const CollisionMask& walls, const CollisionMask* phaseWalls, uint32_t solidPhases) {
+        step(clearance, walls, phaseWalls, solidPhases, 0, count);
+    }
+
+    // the cells hazard ii covers: slices [firstSlice, lastSlice] and numPositions positions from
+    // firstPosition on, which may be outside [0, perimeter)
+    void cells(int ii, int& firstSlice, int& lastSlice, int& firstPosition, int& numPositions) const {
+        firstSlice = static_cast<int>(floorf(slice[ii] - halfSlices[ii]));
+        lastSlice = static_cast<int>(floorf(slice[ii] + halfSlices[ii]));
+        firstPosition = static_cast<int>(floorf(position[ii] - halfPositions[ii]));
+        numPositions = static_cast<int>(floorf(position[ii] + halfPositions[ii])) - firstPosition + 1;
+    }
+
+    // Passes the live hazards to visit, which saves, restores or hashes them; see Replay.h.
+    template<typename Visitor>
+    void visitState(Visitor& visit) {
+        visit(count);
+        count = std::max(0, std::min(count, maxCount));
+        visit.array(slice.get(), count);
+        visit.array(position.get(), count);
+        visit.array(sliceVel.get(), count);
+        visit.array(positionVel.get(), count);
+        visit.array(halfSlices.get(), count);
+        visit.array(halfPositions.get(), count);
+        visit.array(kind.get(), count);
+    }
+
+    int count;
+    int maxCount;
+    int perimeter;
+    std::unique_ptr<float[]> slice;
+    std::unique_ptr<float[]> position;       // in [0, perimeter)
+    std::unique_ptr<float[]> sliceVel;
+    std::unique_ptr<float[]> positionVel;
+    std::unique_ptr<float[]> halfSlices;
+    std::unique_ptr<float[]> halfPositions;
+    std::unique_ptr<uint8_t[]> kind;          // what the game makes of it
+
+private:
+    float wrap(float value) const {
+        const float size = static_cast<float>(perimeter);
+        if (value < 0.0f)
+            value += size;
+        else if (value >= size)
+            value -= size;
+        return value;
+    }
+
+    static bool boxHasWall(const CollisionMask& walls, const CollisionMask* phaseWalls, uint32_t solidPhases,
+        float atSlice, float atPosition, float halfS, float halfP) {
+        const int firstSlice = static_cast<int>(floorf(atSlice - halfS));
+        const int lastSlice = static_cast<int>(floorf(atSlice + halfS));
+        const int firstPosition = static_cast<int>(floorf(atPosition - halfP));
+        const int numPositions = static_cast<int>(floorf(atPosition + halfP)) - firstPosition + 1;
+        if (walls.boxHasWall(firstSlice, lastSlice, firstPosition, numPositions))
+            return true;
+        for (int group = 0; solidPhases; solidPhases >>= 1, ++group) {
+            if ((solidPhases & 1u) && phaseWalls[group].boxHasWall(firstSlice, lastSlice, firstPosition, numPositions))
+                return true;
+        }
+        return false;
+    }
+};
+
+// Which hazards are near what, as a spatial hash over buckets of bucketCells x bucketCells cells
+// keyed by (slice bucket, perimeter bucket). Perimeter buckets wrap round the seam, and the last one
+// is short if the perimeter isn't a multiple of bucketCells. Slices go on for ever, so buckets hash
+// into a table a few times the pool's size; buckets that share a slot just make a query look at a
+// few more hazards.
+//
+// build() is a counting sort of every hazard into each bucket its box covers: one pass over the
+// hazards to count, one over what it counted to place, no allocation once the arrays have grown.
+// Queries visit the hazards in the buckets they cover, each once, so only one query may run at a
+// time.
+class CylinderHash
+{
+public:
+    static const int bucketCells = 8;
+
+    CylinderHash(int perimeter, int capacity)
+        : perimeter(perimeter)
+        , tableSize(64)
+        , queryStamp(0)
+        , stamps(capacity, 0)
+    {
+        while (tableSize < 2 * capacity) {
+            tableSize *= 2;
+        }
+        starts.assign(tableSize + 1, 0);
+    }
+
+    // capacity only sizes the table; a bigger pool makes more hazards share slots
+    void build(const HazardPool& pool) {
+        if (stamps.size() < static_cast<size_t>(pool.size()))
+            stamps.resize(pool.size(), 0);
+        std::fill(starts.begin(), starts.end(), 0);
+        placements.clear();
+        for (int ii = 0; ii < pool.size(); ++ii) {
+            forEachBucket(pool, ii, [&](int slot) {
+                ++starts[slot + 1];
+                placements.push_back(Placement{ slot, ii });
+            });
+        }
+        for (int slot = 0; slot < tableSize; ++slot) {
+            starts[slot + 1] += starts[slot];
+        }
+        entries.resize(placements.size());
+        // starts[slot] walks up to where slot + 1 begins, then everything moves back one
+        for (const Placement& placement : placements) {
+            entries[starts[placement.slot]++] = placement.hazard;
+        }
+        for (int slot = tableSize; slot > 0; --slot) {
+            starts[slot] = starts[slot - 1];
+        }
+        starts[0] = 0;
+    }
+
+    // f(ii) for every hazard whose box touches the box of half extents (halfS, halfP) about
+    // (atSlice, atPosition)
+    template<typename F>
+    void query(const HazardPool& pool, float atSlice, float atPosition, float halfS, float halfP, const F& f) {
+        const float size = static_cast<float>(perimeter);
+        const int firstPosition = static_cast<int>(floorf(atPosition - halfP));
+        visitBuckets(static_cast<int>(floorf(atSlice - halfS)), static_cast<int>(floorf(atSlice + halfS)),
+            firstPosition, static_cast<int>(floorf(atPosition + halfP)) - firstPosition + 1, [&](int ii) {
+                if (fabsf(pool.slice[ii] - atSlice) > pool.halfSlices[ii] + halfS)
+                    return;
+                float apart = fmodf(fabsf(pool.position[ii] - atPosition), size);
+                apart = std::min(apart, size - apart);
+                if (apart <= pool.halfPositions[ii] + halfP)
+                    f(ii);
+            });
+    }
+
+    // f(ii) for every hazard that covers a cell footprint does, from (firstSlice, firstPosition) on:
+    // the same test as CollisionMask::overlaps(), against the hazard's cells instead of the walls
+    template<typename F>
+    void queryFootprint(const HazardPool& pool, const Footprint& footprint, int firstSlice, int firstPosition, const F& f) {
+        visitBuckets(firstSlice, firstSlice + footprint.slices() - 1, firstPosition, footprint.positions(), [&](int ii) {
+            int hazardFirstSlice, hazardLastSlice, hazardFirstPosition, numPositions;
+            pool.cells(ii, hazardFirstSlice, hazardLastSlice, hazardFirstPosition, numPositions);
+            // where the hazard's cells start from the footprint's, round whichever way is nearer
+            int offset = ((hazardFirstPosition - firstPosition) % perimeter + perimeter) % perimeter;
+            if (offset > perimeter - numPositions)
+                offset -= perimeter;
+            const uint64_t columns = bitRange(offset, offset + numPositions);
+            const int begin = std::max(firstSlice, hazardFirstSlice);
+            const int end = std::min(firstSlice + footprint.slices() - 1, hazardLastSlice);
+            for (int row = begin; row <= end; ++row) {
+                if (footprint.row(row - firstSlice) & columns) {
+                    f(ii);
+                    return;
+                }
+            }
+        });
+    }
+
+private:
+    int slotOf(int sliceBucket, int perimeterBucket) const {
+        const uint32_t key = static_cast<uint32_t>(sliceBucket) * 0x9E3779B1u ^ static_cast<uint32_t>(perimeterBucket) * 0x85EBCA77u;
+        return static_cast<int>((key ^ (key >> 15)) & static_cast<uint32_t>(tableSize - 1));
+    }
+
+    // the slot of every bucket that slices [firstSlice, lastSlice] and numPositions positions from
+    // firstPosition on cover; a slot can come up more than once
+    template<typename F>
+    void forEachSlot(int firstSlice, int lastSlice, int firstPosition, int numPositions, const F& f) const {
+        numPositions = std::min(numPositions, perimeter);
+        const int firstSliceBucket = floorDiv(firstSlice, bucketCells);
+        const int lastSliceBucket = floorDiv(lastSlice, bucketCells);
+        for (int sliceBucket = firstSliceBucket; sliceBucket <= lastSliceBucket; ++sliceBucket) {
+            for (int cell = 0; cell < numPositions;) {
+                const int wrapped = ((firstPosition + cell) % perimeter + perimeter) % perimeter;
+                f(slotOf(sliceBucket, wrapped / bucketCells));
+                cell += std::min(bucketCells - wrapped % bucketCells, perimeter - wrapped);
+            }
+        }
+    }
+
+    template<typename F>
+    void forEachBucket(const HazardPool& pool, int ii, const F& f) const {
+        int firstSlice, lastSlice, firstPosition, numPositions;
+        pool.cells(ii, firstSlice, lastSlice, firstPosition, numPositions);
+        forEachSlot(firstSlice, lastSlice, firstPosition, numPositions, f);
+    }
+
+    // visit(ii) once for every hazard in the buckets a box of cells covers
+    template<typename F>
+    void visitBuckets(int firstSlice, int lastSlice, int firstPosition, int numPositions, const F& visit) {
+        ++queryStamp;
+        forEachSlot(firstSlice, lastSlice, firstPosition, numPositions, [&](int slot) {
+            for (int entry = starts[slot]; entry < starts[slot + 1]; ++entry) {
+                const int ii = entries[entry];
+                if (stamps[ii] != queryStamp) {
+                    stamps[ii] = queryStamp;
+                    visit(ii);
+                }
+            }
+        });
+    }
+
+    static int floorDiv(int value, int divisor) {
+        return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+    }
+
+    // bits [begin, end) of a word, clipped to it
+    static uint64_t bitRange(int begin, int end) {
+        begin = std::max(begin, 0);
+        end = std::min(end, 64);
+        if (begin >= end)
+            return 0;
+        const uint64_t high = end == 64 ? ~uint64_t(0) : (uint64_t(1) << end) - 1;
+        return high & (~uint64_t(0) << begin);
+    }
+
+    int perimeter;
+    int tableSize;
+    uint32_t queryStamp;
+    std::vector<uint32_t> stamps;  // queryStamp of the last query that visited each hazard
+    std::vector<int> starts;       // tableSize + 1: entries of slot s are [starts[s], starts[s + 1])
+    std::vector<int> entries;      // hazard indices, by slot
+
+    typedef struct Placement {
+        int slot;
+        int hazard;
+    } Placement;
+    std::vector<Placement> placements; // build()'s scratch, in hazard order
+};
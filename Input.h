@@ -0,0 +1,192 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "raylib.h"
+
+// Buttons the game reacts to. Game states only ever see these, never raw keys, so a tick can be
+// driven by the keyboard, a script or a file.
+enum InputButton : uint32_t {
+    BUTTON_UP = 1 << 0,
+    BUTTON_DOWN = 1 << 1,
+    BUTTON_LEFT = 1 << 2,
+    BUTTON_RIGHT = 1 << 3,
+    BUTTON_CONFIRM = 1 << 4,
+    BUTTON_PAUSE = 1 << 5,
+    BUTTON_NO_KILL = 1 << 6,
+    BUTTON_DEBUG = 1 << 7,
+    BUTTON_SERIAL_JOBS = 1 << 8,
+    BUTTON_REWIND = 1 << 9,
+    // for the main loop rather than the game
+    BUTTON_PROFILER = 1 << 10,
+    BUTTON_TRACE = 1 << 11,
+    BUTTON_MEMORY = 1 << 12,
+};
+
+// Input for one sim tick.
+typedef struct InputFrame {
+    uint32_t held;      // buttons that are down
+    uint32_t pressed;   // buttons that went down this tick
+
+    bool down(uint32_t buttons) const { return (held & buttons) != 0; }
+    bool hit(uint32_t buttons) const { return (pressed & buttons) != 0; }
+} InputFrame;
+
+class InputSource
+{
+public:
+    virtual ~InputSource() {}
+
+    // input for the next sim tick
+    virtual InputFrame next() = 0;
+};
+
+class KeyboardInput : public InputSource
+{
+public:
+    InputFrame next() override {
+        static const struct { int key; uint32_t button; } bindings[] = {
+            { KEY_UP, BUTTON_UP }, { KEY_W, BUTTON_UP },
+            { KEY_DOWN, BUTTON_DOWN }, { KEY_S, BUTTON_DOWN },
+            { KEY_LEFT, BUTTON_LEFT }, { KEY_A, BUTTON_LEFT },
+            { KEY_RIGHT, BUTTON_RIGHT }, { KEY_D, BUTTON_RIGHT },
+            { KEY_SPACE, BUTTON_CONFIRM }, { KEY_ENTER, BUTTON_CONFIRM },
+            { KEY_P, BUTTON_PAUSE },
+            { KEY_K, BUTTON_NO_KILL },
+            { KEY_ZERO, BUTTON_DEBUG },
+            { KEY_J, BUTTON_SERIAL_JOBS },
+            { KEY_R, BUTTON_REWIND }, { KEY_BACKSPACE, BUTTON_REWIND },
+            { KEY_F3, BUTTON_PROFILER }, { KEY_F4, BUTTON_TRACE }, { KEY_F5, BUTTON_MEMORY },
+        };
+        InputFrame frame{ 0, 0 };
+        for (const auto& binding : bindings) {
+            if (IsKeyDown(binding.key))
+                frame.held |= binding.button;
+            if (IsKeyPressed(binding.key))
+                frame.pressed |= binding.button;
+        }
+        return frame;
+    }
+};
+
+// Plays back a list of steps, each holding a set of buttons for some number of ticks; nothing is
+// held once the script runs out. Scripts can be built in code or read from text, one step per
+// line:
+//
+//    # comment
+//    120 up
+//    30 up+left
+//    1 pause
+//    60 none
+class ScriptedInput : public InputSource
+{
+public:
+    ScriptedInput()
+        : step(0)
+        , tickInStep(0)
+        , lastHeld(0)
+    {
+    }
+
+    void add(int ticks, uint32_t held) {
+        if (ticks > 0)
+            steps.push_back({ ticks, held });
+    }
+
+    bool finished() const { return step >= steps.size(); }
+
+    InputFrame next() override {
+        while (step < steps.size() && tickInStep >= steps[step].ticks) {
+            ++step;
+            tickInStep = 0;
+        }
+        InputFrame frame{ 0, 0 };
+        if (step < steps.size()) {
+            frame.held = steps[step].held;
+            ++tickInStep;
+        }
+        frame.pressed = frame.held & ~lastHeld;
+        lastHeld = frame.held;
+        return frame;
+    }
+
+    // Appends the steps in text; on a malformed line returns false and sets error.
+    bool parse(const std::string& text, std::string& error) {
+        std::istringstream lines(text);
+        std::string line;
+        for (int lineNumber = 1; std::getline(lines, line); ++lineNumber) {
+            const size_t comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+            std::istringstream fields(line);
+            long long ticks = 0;
+            std::string names;
+            if (!(fields >> ticks)) {
+                if (line.find_first_not_of(" \t\r") == std::string::npos)
+                    continue;
+                error = "line " + std::to_string(lineNumber) + ": expected a tick count";
+                return false;
+            }
+            uint32_t held = 0;
+            if (ticks <= 0 || ticks > INT_MAX || !(fields >> names) || !parseButtons(names, held)) {
+                error = "line " + std::to_string(lineNumber) + ": expected '<ticks> <button>[+<button>...]'";
+                return false;
+            }
+            add(static_cast<int>(ticks), held);
+        }
+        return true;
+    }
+
+    bool load(const char* path, std::string& error) {
+        std::ifstream file(path);
+        if (!file) {
+            error = std::string("cannot open ") + path;
+            return false;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        return parse(text.str(), error);
+    }
+
+private:
+    typedef struct Step {
+        int ticks;
+        uint32_t held;
+    } Step;
+
+    static bool parseButtons(const std::string& names, uint32_t& held) {
+        static const struct { const char* name; uint32_t button; } buttons[] = {
+            { "none", 0 },
+            { "up", BUTTON_UP }, { "down", BUTTON_DOWN }, { "left", BUTTON_LEFT }, { "right", BUTTON_RIGHT },
+            { "confirm", BUTTON_CONFIRM }, { "pause", BUTTON_PAUSE }, { "nokill", BUTTON_NO_KILL },
+            { "debug", BUTTON_DEBUG }, { "serial", BUTTON_SERIAL_JOBS }, { "rewind", BUTTON_REWIND },
+        };
+        size_t begin = 0;
+        while (begin <= names.size()) {
+            size_t end = names.find('+', begin);
+            if (end == std::string::npos)
+                end = names.size();
+            const std::string name = names.substr(begin, end - begin);
+            bool known = false;
+            for (const auto& button : buttons) {
+                if (name == button.name) {
+                    held |= button.button;
+                    known = true;
+                }
+            }
+            if (!known)
+                return false;
+            begin = end + 1;
+        }
+        return true;
+    }
+
+    std::vector<Step> steps;
+    size_t step;
+    int tickInStep;
+    uint32_t lastHeld;
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Profiler.h"
+
+// Small work-stealing job system.
+//
+// Every worker owns a fixed ring of jobs. It pops its own work from the back and steals from the
+// front of the other rings when it runs dry. The thread calling parallelFor() pushes the pieces of
+// its range round-robin over all rings and then helps out until every piece has run, so callers
+// never block on a worker that is busy elsewhere. Jobs are a function pointer plus context, so
+// queueing work never allocates.
+class JobSystem
+{
+public:
+    // numWorkers < 0 picks one worker per hardware thread, leaving one for the caller
+    explicit JobSystem(int numWorkers = -1)
+        : serial(false)
+        , quit(false)
+        , queued(0)
+    {
+        if (numWorkers < 0) {
+            numWorkers = std::max(0, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+        }
+        numQueues = numWorkers + 1; // queue 0 is shared by all non-worker callers
+        queues.reset(new JobQueue[numQueues]);
+        for (int ii = 0; ii < numWorkers; ++ii) {
+            workers.emplace_back([this, ii]() { workerLoop(ii + 1); });
+        }
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Runs fn(begin, end) over [0, count) in pieces of at most grain items and returns once all
+    // pieces are done. Pieces may run in any order on any thread; callers that need deterministic
+    // output write into per-piece buffers and combine them in index order afterwards.
+    template<typename F>
+    void parallelFor(int count, int grain, const F& fn)
+    {
+        if (count <= 0)
+            return;
+        grain = std::max(1, grain);
+        const int numJobs = (count + grain - 1) / grain;
+        if (serial || workers.empty() || numJobs == 1) {
+            fn(0, count);
+            return;
+        }
+
+        std::atomic<int> pending(numJobs);
+        const int home = homeQueue();
+        Job job;
+        job.fn = &invoke<F>;
+        job.ctx = &fn;
+        job.pending = &pending;
+        for (int jj = 0; jj < numJobs; ++jj) {
+            job.begin = jj * grain;
+            job.end = std::min(count, job.begin + grain);
+            if (!queues[(home + jj) % numQueues].push(job)) {
+                run(job); // ring is full, do it here
+                continue;
+            }
+            queued.fetch_add(1);
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_all();
+
+        while (pending.load(std::memory_order_acquire) > 0) {
+            if (!runOne(home))
+                std::this_thread::yield();
+        }
+    }
+
+    // number of threads that can work on a parallelFor at once, including the caller
+    int numThreads() const { return serial ? 1 : static_cast<int>(workers.size()) + 1; }
+
+    // when set every parallelFor runs inline on the calling thread; may be flipped from any thread
+    std::atomic<bool> serial;
+
+private:
+    typedef struct Job {
+        void (*fn)(const void* ctx, int begin, int end);
+        const void* ctx;
+        int begin;
+        int end;
+        std::atomic<int>* pending;
+    } Job;
+
+    class JobQueue
+    {
+    public:
+        JobQueue() : head(0), tail(0) {}
+
+        bool push(const Job& job)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tail - head == capacity)
+                return false;
+            jobs[tail % capacity] = job;
+            ++tail;
+            return true;
+        }
+        bool popBack(Job& job)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tail == head)
+                return false;
+            --tail;
+            job = jobs[tail % capacity];
+            return true;
+        }
+        bool popFront(Job& job)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (tail == head)
+                return false;
+            job = jobs[head % capacity];
+            ++head;
+            return true;
+        }
+
+    private:
+        static const size_t capacity = 256;
+        std::mutex mutex;
+        Job jobs[capacity];
+        size_t head;
+        size_t tail;
+    };
+
+    template<typename F>
+    static void invoke(const void* ctx, int begin, int end)
+    {
+        (*static_cast<const F*>(ctx))(begin, end);
+    }
+
+    static void run(const Job& job)
+    {
+        PROFILE_SCOPE("job");
+        job.fn(job.ctx, job.begin, job.end);
+        job.pending->fetch_sub(1, std::memory_order_release);
+    }
+
+    bool runOne(int home)
+    {
+        Job job;
+        bool found = queues[home].popBack(job);
+        for (int ii = 1; !found && ii < numQueues; ++ii) {
+            found = queues[(home + ii) % numQueues].popFront(job);
+        }
+        if (!found)
+            return false;
+        queued.fetch_sub(1);
+        run(job);
+        return true;
+    }
+
+    void workerLoop(int home)
+    {
+        PROFILE_THREAD("worker");
+        homeQueue() = home;
+        while (true) {
+            if (runOne(home))
+                continue;
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]() { return quit || queued.load() > 0; });
+            if (quit)
+                return;
+        }
+    }
+
+    int numQueues;
+    std::unique_ptr<JobQueue[]> queues;
+    std::vector<std::thread> workers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool quit;
+    std::atomic<int> queued;
+
+    // ring the current thread pushes to and pops from first; 0 for threads outside the pool
+    static int& homeQueue()
+    {
+        static thread_local int queue = 0;
+        return queue;
+    }
+};
+
+// process wide job system, created on first use
+inline JobSystem& jobSystem()
+{
+    static JobSystem jobs;
+    return jobs;
+}
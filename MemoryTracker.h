@@ -0,0 +1,310 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "raylib.h"
+
+// Memory by subsystem. Every heap block is charged to the tag of the thread that allocated it, which
+// is General unless a MemoryTagScope says otherwise; operator new (main.cpp) keeps the tag and size
+// in a header in front of the block, so operator delete takes it off the same tag whichever thread
+// frees it. What raylib allocates itself (images, sounds, render targets) is charged through the
+// tracked*() wrappers below instead, which must be used for both the load and the unload.
+//
+// Counters are relaxed atomics, one set per tag: bytes held now and at most, blocks allocated ever and
+// held now. memorySnapshot() reads them all, writeMemoryReport() prints one, and MemoryCheckpoints
+// compares them between visits to the same game state to catch what a transition leaves behind.
+enum class MemoryTag : unsigned char { General, Level, Effects, Images, Audio, Render, Replay, Arenas, Count };
+
+static const int numMemoryTags = static_cast<int>(MemoryTag::Count);
+
+inline const char* memoryTagName(MemoryTag tag)
+{
+    static const char* const names[numMemoryTags] = { "general", "level", "effects", "images", "audio", "render", "replay", "arenas" };
+    return names[static_cast<int>(tag)];
+}
+
+namespace memory {
+
+typedef struct Counters {
+    std::atomic<int64_t> bytes;
+    std::atomic<int64_t> peak;
+    std::atomic<int64_t> allocations;
+    std::atomic<int64_t> live;
+} Counters;
+
+inline Counters& counters(MemoryTag tag)
+{
+    static Counters all[numMemoryTags]; // zero before anything runs, and never destroyed
+    return all[static_cast<int>(tag)];
+}
+
+inline MemoryTag& currentTag()
+{
+    thread_local MemoryTag tag = MemoryTag::General;
+    return tag;
+}
+
+// in front of every block from operator new; a multiple of the strictest alignment malloc keeps
+typedef struct HeapHeader {
+    uint64_t size;
+    MemoryTag tag;
+} HeapHeader;
+
+static const size_t heapHeaderSize = 16;
+
+} // namespace memory
+
+inline void trackAllocation(MemoryTag tag, size_t size)
+{
+    memory::Counters& counters = memory::counters(tag);
+    const int64_t bytes = counters.bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) + static_cast<int64_t>(size);
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.live.fetch_add(1, std::memory_order_relaxed);
+    int64_t peak = counters.peak.load(std::memory_order_relaxed);
+    while (bytes > peak && !counters.peak.compare_exchange_weak(peak, bytes, std::memory_order_relaxed)) {
+    }
+}
+
+inline void trackFree(MemoryTag tag, size_t size)
+{
+    memory::Counters& counters = memory::counters(tag);
+    counters.bytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+    counters.live.fetch_sub(1, std::memory_order_relaxed);
+}
+
+// operator new's side: block is heapHeaderSize + size bytes from malloc; returns what to hand out
+inline void* tagHeapBlock(void* block, size_t size)
+{
+    memory::HeapHeader* header = static_cast<memory::HeapHeader*>(block);
+    header->size = size;
+    header->tag = memory::currentTag();
+    trackAllocation(header->tag, size);
+    return static_cast<char*>(block) + memory::heapHeaderSize;
+}
+
+// operator delete's side: the block to free for what tagHeapBlock() handed out
+inline void* untagHeapBlock(void* ptr)
+{
+    void* block = static_cast<char*>(ptr) - memory::heapHeaderSize;
+    const memory::HeapHeader* header = static_cast<const memory::HeapHeader*>(block);
+    trackFree(header->tag, static_cast<size_t>(header->size));
+    return block;
+}
+
+// Charges what this thread allocates to tag until the end of the scope.
+class MemoryTagScope
+{
+public:
+    explicit MemoryTagScope(MemoryTag tag)
+        : previous(memory::currentTag())
+    {
+        memory::currentTag() = tag;
+    }
+
+    ~MemoryTagScope()
+    {
+        memory::currentTag() = previous;
+    }
+
+    MemoryTagScope(const MemoryTagScope&) = delete;
+    MemoryTagScope& operator=(const MemoryTagScope&) = delete;
+
+private:
+    MemoryTag previous;
+};
+
+// raylib's own buffers
+inline Image trackedLoadImage(const char* file)
+{
+    const Image image = LoadImage(file);
+    if (image.data)
+        trackAllocation(MemoryTag::Images, GetPixelDataSize(image.width, image.height, image.format));
+    return image;
+}
+
+inline void trackedUnloadImage(Image image)
+{
+    if (image.data)
+        trackFree(MemoryTag::Images, GetPixelDataSize(image.width, image.height, image.format));
+    UnloadImage(image);
+}
+
+inline Color* trackedLoadImageColors(Image image)
+{
+    Color* colors = LoadImageColors(image);
+    if (colors)
+        trackAllocation(MemoryTag::Images, size_t(image.width) * image.height * sizeof(Color));
+    return colors;
+}
+
+// image is the one the colors came from
+inline void trackedUnloadImageColors(Color* colors, Image image)
+{
+    if (colors)
+        trackFree(MemoryTag::Images, size_t(image.width) * image.height * sizeof(Color));
+    UnloadImageColors(colors);
+}
+
+inline size_t soundBytes(const Sound& sound)
+{
+    return size_t(sound.sampleCount) * sound.stream.sampleSize / 8;
+}
+
+inline Sound trackedLoadSound(const char* file)
+{
+    const Sound sound = LoadSound(file);
+    if (sound.sampleCount)
+        trackAllocation(MemoryTag::Audio, soundBytes(sound));
+    return sound;
+}
+
+inline Sound trackedLoadSoundFromWave(Wave wave)
+{
+    const Sound sound = LoadSoundFromWave(wave);
+    if (sound.sampleCount)
+        trackAllocation(MemoryTag::Audio, soundBytes(sound));
+    return sound;
+}
+
+inline void trackedUnloadSound(Sound sound)
+{
+    if (sound.sampleCount)
+        trackFree(MemoryTag::Audio, soundBytes(sound));
+    UnloadSound(sound);
+}
+
+// on the GPU, but it goes with the window's size all the same
+inline RenderTexture2D trackedLoadRenderTexture(int width, int height)
+{
+    const RenderTexture2D target = LoadRenderTexture(width, height);
+    if (target.id)
+        trackAllocation(MemoryTag::Render, size_t(width) * height * 4);
+    return target;
+}
+
+inline void trackedUnloadRenderTexture(RenderTexture2D target)
+{
+    if (target.id)
+        trackFree(MemoryTag::Render, size_t(target.texture.width) * target.texture.height * 4);
+    UnloadRenderTexture(target);
+}
+
+typedef struct MemoryUsage {
+    int64_t bytes;
+    int64_t peak;
+    int64_t allocations;
+    int64_t live;
+} MemoryUsage;
+
+typedef struct MemorySnapshot {
+    MemoryUsage tags[numMemoryTags];
+
+    MemoryUsage total() const {
+        MemoryUsage sum = { 0, 0, 0, 0 };
+        for (const MemoryUsage& usage : tags) {
+            sum.bytes += usage.bytes;
+            sum.peak += usage.peak;
+            sum.allocations += usage.allocations;
+            sum.live += usage.live;
+        }
+        return sum;
+    }
+} MemorySnapshot;
+
+inline MemorySnapshot memorySnapshot()
+{
+    MemorySnapshot snapshot;
+    for (int ii = 0; ii < numMemoryTags; ++ii) {
+        const memory::Counters& counters = memory::counters(static_cast<MemoryTag>(ii));
+        snapshot.tags[ii].bytes = counters.bytes.load(std::memory_order_relaxed);
+        snapshot.tags[ii].peak = counters.peak.load(std::memory_order_relaxed);
+        snapshot.tags[ii].allocations = counters.allocations.load(std::memory_order_relaxed);
+        snapshot.tags[ii].live = counters.live.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+// One line per tag and a total, into a buffer; for the overlay, which must not allocate. Returns the
+// text of line (0 is the heading), or nullptr past the last one.
+inline const char* memoryReportLine(const MemorySnapshot& snapshot, int line, char* buffer, size_t size)
+{
+    if (line == 0) {
+        snprintf(buffer, size, "%-8s %11s %11s %12s %9s", "memory", "now KB", "peak KB", "allocations", "live");
+        return buffer;
+    }
+    if (line > numMemoryTags + 1)
+        return nullptr;
+    const bool total = line == numMemoryTags + 1;
+    const MemoryUsage usage = total ? snapshot.total() : snapshot.tags[line - 1];
+    snprintf(buffer, size, "%-8s %11lld %11lld %12lld %9lld", total ? "total" : memoryTagName(static_cast<MemoryTag>(line - 1)),
+        static_cast<long long>(usage.bytes / 1024), static_cast<long long>(usage.peak / 1024),
+        static_cast<long long>(usage.allocations), static_cast<long long>(usage.live));
+    return buffer;
+}
+
+inline void writeMemoryReport(std::ostream& out, const MemorySnapshot& snapshot)
+{
+    char buffer[96];
+    for (int line = 0; memoryReportLine(snapshot, line, buffer, sizeof(buffer)); ++line) {
+        out << buffer << "\n";
+    }
+}
+
+// Snapshots taken each time the game arrives in a state, by name. Coming back to a state should
+// leave every tag where it was on the last visit, so a tag that has grown by leakBytes or more since
+// is reported as a possible leak. The first visit to a state comes before anything has warmed up
+// (arenas, render targets), so it is only compared against from the third on.
+class MemoryCheckpoints
+{
+public:
+    static const int64_t leakBytes = 16 * 1024;
+
+    // the warnings it raises, if any, are also returned
+    std::vector<std::string> arrive(const char* state) {
+        const MemorySnapshot now = memorySnapshot();
+        std::vector<std::string> found;
+        Visits* visits = nullptr;
+        for (Visits& candidate : states) {
+            if (candidate.state == state)
+                visits = &candidate;
+        }
+        if (!visits) {
+            states.push_back(Visits{ state, 0, now });
+            return found;
+        }
+        ++visits->count;
+        if (visits->count >= 2) {
+            for (int ii = 0; ii < numMemoryTags; ++ii) {
+                const int64_t grown = now.tags[ii].bytes - visits->last.tags[ii].bytes;
+                if (grown < leakBytes)
+                    continue;
+                char line[160];
+                snprintf(line, sizeof(line), "%s, visit %d: %s up %lld KB and %lld blocks since the last visit",
+                    state, visits->count + 1, memoryTagName(static_cast<MemoryTag>(ii)), static_cast<long long>(grown / 1024),
+                    static_cast<long long>(now.tags[ii].live - visits->last.tags[ii].live));
+                found.push_back(line);
+            }
+        }
+        visits->last = now;
+        warnings.insert(warnings.end(), found.begin(), found.end());
+        return found;
+    }
+
+    const std::vector<std::string>& allWarnings() const { return warnings; }
+
+private:
+    typedef struct Visits {
+        std::string state;
+        int count; // after the first
+        MemorySnapshot last;
+    } Visits;
+
+    std::vector<Visits> states;
+    std::vector<std::string> warnings;
+};
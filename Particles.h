@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include "MemoryTracker.h"
+#include "Random.h"
+
+// Fixed capacity structure-of-arrays particle pool.
+//
+// A particle is a streak in sim space (x = slice, y = position in slice) with a tail and a head
+// point that each move at their own constant velocity, which covers both explosion shards and
+// sparks. Live particles are packed in [0, size()); a particle that reaches its lifetime is
+// replaced by the last live one, so the update kernels always run over dense arrays.
+class ParticlePool
+{
+public:
+    explicit ParticlePool(int capacity)
+        : count(0)
+        , maxCount(capacity)
+    {
+        MemoryTagScope tag(MemoryTag::Effects);
+        tailX.reset(new float[capacity]);
+        tailY.reset(new float[capacity]);
+        headX.reset(new float[capacity]);
+        headY.reset(new float[capacity]);
+        tailVelX.reset(new float[capacity]);
+        tailVelY.reset(new float[capacity]);
+        headVelX.reset(new float[capacity]);
+        headVelY.reset(new float[capacity]);
+        age.reset(new uint16_t[capacity]);
+        life.reset(new uint16_t[capacity]);
+        colorIndex.reset(new uint8_t[capacity]);
+    }
+
+    ParticlePool(const ParticlePool&) = delete;
+    ParticlePool& operator=(const ParticlePool&) = delete;
+
+    int size() const { return count; }
+    int capacity() const { return maxCount; }
+    int available() const { return maxCount - count; }
+    void clear() { count = 0; }
+
+    // returns false when the pool is full
+    bool spawn(float x, float y, float tailVx, float tailVy, float headVx, float headVy, int lifetime, int color) {
+        if (count == maxCount)
+            return false;
+        const int ii = count++;
+        tailX[ii] = headX[ii] = x;
+        tailY[ii] = headY[ii] = y;
+        tailVelX[ii] = tailVx;
+        tailVelY[ii] = tailVy;
+        headVelX[ii] = headVx;
+        headVelY[ii] = headVy;
+        age[ii] = 0;
+        life[ii] = static_cast<uint16_t>(std::max(1, std::min(lifetime, 0xffff)));
+        colorIndex[ii] = static_cast<uint8_t>(color);
+        return true;
+    }
+
+    // one sim tick: integrate, age, then swap-remove expired particles
+    void update() {
+        integrate(tailX.get(), tailVelX.get(), count);
+        integrate(tailY.get(), tailVelY.get(), count);
+        integrate(headX.get(), headVelX.get(), count);
+        integrate(headY.get(), headVelY.get(), count);
+
+        uint16_t* const __restrict ages = age.get();
+        for (int ii = 0; ii < count; ++ii) {
+            ages[ii]++;
+        }
+
+        for (int ii = 0; ii < count;) {
+            if (age[ii] >= life[ii]) {
+                moveParticle(--count, ii);
+            }
+            else {
+                ++ii;
+            }
+        }
+    }
+
+    // Passes the live particles to visit, which saves, restores or hashes them; see Replay.h.
+    template<typename Visitor>
+    void visitState(Visitor& visit) {
+        visit(count);
+        count = std::max(0, std::min(count, maxCount));
+        visit.array(tailX.get(), count);
+        visit.array(tailY.get(), count);
+        visit.array(headX.get(), count);
+        visit.array(headY.get(), count);
+        visit.array(tailVelX.get(), count);
+        visit.array(tailVelY.get(), count);
+        visit.array(headVelX.get(), count);
+        visit.array(headVelY.get(), count);
+        visit.array(age.get(), count);
+        visit.array(life.get(), count);
+        visit.array(colorIndex.get(), count);
+    }
+
+    int count;
+    int maxCount;
+    std::unique_ptr<float[]> tailX;
+    std::unique_ptr<float[]> tailY;
+    std::unique_ptr<float[]> headX;
+    std::unique_ptr<float[]> headY;
+    std::unique_ptr<float[]> tailVelX;
+    std::unique_ptr<float[]> tailVelY;
+    std::unique_ptr<float[]> headVelX;
+    std::unique_ptr<float[]> headVelY;
+    std::unique_ptr<uint16_t[]> age;
+    std::unique_ptr<uint16_t[]> life;
+    std::unique_ptr<uint8_t[]> colorIndex;
+
+private:
+    // branch free and dependency free, so the compiler turns it into SIMD adds
+    static void integrate(float* __restrict pos, const float* __restrict vel, int n) {
+        for (int ii = 0; ii < n; ++ii) {
+            pos[ii] += vel[ii];
+        }
+    }
+
+    void moveParticle(int from, int to) {
+        tailX[to] = tailX[from];
+        tailY[to] = tailY[from];
+        headX[to] = headX[from];
+        headY[to] = headY[from];
+        tailVelX[to] = tailVelX[from];
+        tailVelY[to] = tailVelY[from];
+        headVelX[to] = headVelX[from];
+        headVelY[to] = headVelY[from];
+        age[to] = age[from];
+        life[to] = life[from];
+        colorIndex[to] = colorIndex[from];
+    }
+};
+
+// Spawns streaks that fly out of an origin. The owner moves the origin to attach the emitter to
+// something (the player, an explosion) and calls tick() once per sim tick; no more than rate
+// particles are spawned per tick, which bounds the cost of an effect no matter how long it runs.
+class ParticleEmitter
+{
+public:
+    ParticleEmitter()
+        : originX(0.0f)
+        , originY(0.0f)
+        , rate(0)
+        , budget(-1)
+        , emitted(0)
+        , minSpeed(0.0f)
+        , maxSpeed(1.0f)
+        , minTailFactor(0.8f)
+        , maxTailFactor(1.0f)
+        , angle(0.0f)
+        , spread(6.2831853f)
+        , lifetime(60)
+        , numColors(1)
+        , random()
+    {
+    }
+
+    // spawn n particles right away, ignoring rate but not budget
+    int burst(ParticlePool& pool, int n) {
+        if (budget >= 0)
+            n = std::min(n, budget - emitted);
+        int spawned = 0;
+        for (; spawned < n; ++spawned) {
+            const float dirAngle = angle + random.range(-0.5f, 0.5f) * spread;
+            const float dirX = cosf(dirAngle);
+            const float dirY = sinf(dirAngle);
+            const float headSpeed = random.range(minSpeed, maxSpeed);
+            const float tailSpeed = headSpeed * random.range(minTailFactor, maxTailFactor);
+            if (!pool.spawn(originX, originY, dirX * tailSpeed, dirY * tailSpeed, dirX * headSpeed, dirY * headSpeed,
+                lifetime, random.rangeInt(0, numColors - 1)))
+                break;
+        }
+        emitted += spawned;
+        return spawned;
+    }
+
+    int tick(ParticlePool& pool) { return burst(pool, rate); }
+
+    bool exhausted() const { return budget >= 0 && emitted >= budget; }
+    void restart() { emitted = 0; }
+
+    // only what changes while running; the tuning fields are set up once by the owner
+    template<typename Visitor>
+    void visitState(Visitor& visit) {
+        visit(originX);
+        visit(originY);
+        visit(emitted);
+        visit(random.state);
+    }
+
+    float originX;
+    float originY;
+    int rate;           // particles per tick
+    int budget;         // total particles this emitter may spawn, -1 for no limit
+    int emitted;
+    float minSpeed;     // head speed, sim units per tick
+    float maxSpeed;
+    float minTailFactor; // tail speed as a fraction of head speed
+    float maxTailFactor;
+    float angle;        // direction in sim space (x = slice) and the full cone around it
+    float spread;
+    int lifetime;       // ticks
+    int numColors;      // color indices handed out are [0, numColors)
+    Random random;
+};
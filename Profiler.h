@@ -0,0 +1,326 @@
+#pragma once
+
+// Scoped timers and counters for the hot paths.
+//
+//     PROFILE_SCOPE("Sim");                          // times the rest of the enclosing block
+//     PROFILE_COUNT(ProfileCounter::Triangles, n);   // adds n to a per-frame counter
+//     PROFILE_THREAD("worker");                      // names the calling thread in traces
+//
+// Only built with PIXIN_PROFILE defined; otherwise the macros expand to nothing and the functions
+// below are empty, so instrumentation costs nothing in a normal build.
+//
+// Every thread records into its own ring of the last ringSize scopes, so timing never takes a
+// lock. The main loop calls profileFrame() at the start of each frame; drawProfileOverlay() then
+// shows the scopes of the frame before as a flame bar per thread, and writeChromeTrace() saves
+// everything the rings still hold in the Chrome trace format (chrome://tracing, Perfetto).
+
+#include <string>
+
+enum class ProfileCounter { Triangles, Lines, ProjectedVertices, Count };
+
+#if defined(PIXIN_PROFILE)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include "Canvas.h"
+
+namespace profiler {
+
+typedef std::chrono::steady_clock Clock;
+
+inline Clock::time_point epoch()
+{
+    static const Clock::time_point start = Clock::now();
+    return start;
+}
+
+inline int64_t now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch()).count();
+}
+
+// Written only by its thread; read by anyone, who checks the write count again afterwards and
+// ignores scopes that may have been overwritten meanwhile.
+typedef struct Ring {
+    static const uint32_t ringSize = 1 << 14;
+
+    typedef struct Event {
+        std::atomic<const char*> name;
+        std::atomic<int64_t> start; // ns since epoch()
+        std::atomic<int64_t> end;
+        std::atomic<int> depth;
+    } Event;
+
+    Event events[ringSize];
+    std::atomic<uint32_t> written;
+    std::atomic<const char*> threadName;
+    std::atomic<bool> inUse;
+    int depth; // owning thread only
+} Ring;
+
+static const int maxThreads = 64;
+
+typedef struct State {
+    std::atomic<Ring*> rings[maxThreads];
+    std::atomic<int> numRings;
+    std::atomic<long long> counters[static_cast<int>(ProfileCounter::Count)];
+    long long frameCounters[static_cast<int>(ProfileCounter::Count)]; // the last complete frame
+    int64_t frameStart;
+    int64_t previousFrameStart;
+    bool overlayVisible;
+} State;
+
+inline State& state()
+{
+    static State* instance = new State(); // never destroyed; threads may record during exit
+    return *instance;
+}
+
+// Hands a ring to the calling thread, reusing one left by a thread that has exited, and gives it
+// back when the thread ends.
+class ThreadRing
+{
+public:
+    ~ThreadRing()
+    {
+        if (ring)
+            ring->inUse.store(false, std::memory_order_release);
+    }
+
+    Ring* get() {
+        if (!ring)
+            ring = acquire();
+        return ring;
+    }
+
+private:
+    static Ring* acquire() {
+        State& s = state();
+        const int count = s.numRings.load(std::memory_order_acquire);
+        for (int ii = 0; ii < count; ++ii) {
+            Ring* candidate = s.rings[ii].load(std::memory_order_acquire);
+            bool expected = false;
+            if (candidate && candidate->inUse.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+                candidate->depth = 0;
+                candidate->threadName.store("thread", std::memory_order_relaxed);
+                return candidate;
+            }
+        }
+        const int slot = s.numRings.fetch_add(1, std::memory_order_acq_rel);
+        if (slot >= maxThreads)
+            return nullptr;
+        Ring* created = new Ring();
+        created->written.store(0, std::memory_order_relaxed);
+        created->threadName.store("thread", std::memory_order_relaxed);
+        created->inUse.store(true, std::memory_order_relaxed);
+        created->depth = 0;
+        s.rings[slot].store(created, std::memory_order_release);
+        return created;
+    }
+
+    Ring* ring = nullptr;
+};
+
+inline Ring* threadRing()
+{
+    static thread_local ThreadRing ring;
+    return ring.get();
+}
+
+class Scope
+{
+public:
+    explicit Scope(const char* name)
+        : ring(threadRing())
+        , name(name)
+        , start(now())
+    {
+        if (ring)
+            ++ring->depth;
+    }
+
+    ~Scope()
+    {
+        if (!ring)
+            return;
+        const int64_t end = now();
+        --ring->depth;
+        const uint32_t index = ring->written.load(std::memory_order_relaxed);
+        Ring::Event& event = ring->events[index % Ring::ringSize];
+        event.name.store(name, std::memory_order_relaxed);
+        event.start.store(start, std::memory_order_relaxed);
+        event.end.store(end, std::memory_order_relaxed);
+        event.depth.store(ring->depth, std::memory_order_relaxed);
+        ring->written.store(index + 1, std::memory_order_release);
+    }
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Ring* ring;
+    const char* name;
+    int64_t start;
+};
+
+typedef struct EventCopy {
+    const char* name;
+    int64_t start;
+    int64_t end;
+    int depth;
+} EventCopy;
+
+// Calls fn(EventCopy) for the recorded scopes of ring that ended at or after since, newest first.
+template<typename F>
+void forEachEvent(Ring& ring, int64_t since, const F& fn)
+{
+    const uint32_t ringSize = Ring::ringSize;
+    const uint32_t written = ring.written.load(std::memory_order_acquire);
+    const uint32_t available = std::min(written, ringSize);
+    for (uint32_t ii = 1; ii <= available; ++ii) {
+        const Ring::Event& event = ring.events[(written - ii) % ringSize];
+        EventCopy copy = {
+            event.name.load(std::memory_order_relaxed),
+            event.start.load(std::memory_order_relaxed),
+            event.end.load(std::memory_order_relaxed),
+            event.depth.load(std::memory_order_relaxed),
+        };
+        // the owner may have wrapped around onto this slot while it was read
+        if (ring.written.load(std::memory_order_acquire) - (written - ii) >= ringSize)
+            return;
+        if (copy.end < since)
+            return;
+        fn(copy);
+    }
+}
+
+inline Color colorFor(const char* name)
+{
+    uint32_t hash = 2166136261u;
+    for (const char* cc = name; *cc; ++cc) {
+        hash = (hash ^ static_cast<unsigned char>(*cc)) * 16777619u;
+    }
+    return Color{ static_cast<unsigned char>(96 + (hash & 127)), static_cast<unsigned char>(96 + ((hash >> 8) & 127)),
+        static_cast<unsigned char>(96 + ((hash >> 16) & 127)), 230 };
+}
+
+} // namespace profiler
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_COUNT(counter, n) profiler::state().counters[static_cast<int>(counter)].fetch_add((n), std::memory_order_relaxed)
+#define PROFILE_THREAD(name) do { if (profiler::Ring* profileRing = profiler::threadRing()) profileRing->threadName.store(name, std::memory_order_relaxed); } while (0)
+
+// Marks the start of a frame: the counters of the frame that just ended become the ones shown.
+inline void profileFrame()
+{
+    profiler::State& s = profiler::state();
+    s.previousFrameStart = s.frameStart;
+    s.frameStart = profiler::now();
+    for (int ii = 0; ii < static_cast<int>(ProfileCounter::Count); ++ii) {
+        s.frameCounters[ii] = s.counters[ii].exchange(0, std::memory_order_relaxed);
+    }
+}
+
+inline void toggleProfileOverlay()
+{
+    profiler::State& s = profiler::state();
+    s.overlayVisible = !s.overlayVisible;
+}
+
+// Flame bars of the last complete frame along the bottom of the screen, one band per thread, plus
+// the counters. Call between BeginDrawing() and EndDrawing().
+inline void drawProfileOverlay()
+{
+    profiler::State& s = profiler::state();
+    if (!s.overlayVisible || s.previousFrameStart >= s.frameStart)
+        return;
+    Canvas& target = canvas();
+    const int rowHeight = 10;
+    const int maxDepth = 4;
+    const float nsPerPixel = 20e6f / static_cast<float>(target.width()); // the bar spans 20 ms
+    const int numRings = std::min(s.numRings.load(std::memory_order_acquire), profiler::maxThreads);
+    int top = target.height() - numRings * maxDepth * rowHeight - 24;
+    const int bandsTop = top;
+    target.rectangle(0, top - 4, target.width(), target.height() - top + 4, Color{ 0, 0, 0, 180 });
+    for (int rr = 0; rr < numRings; ++rr, top += maxDepth * rowHeight) {
+        profiler::Ring* ring = s.rings[rr].load(std::memory_order_acquire);
+        if (!ring)
+            continue;
+        target.text(ring->threadName.load(std::memory_order_relaxed), 2, top, 8, GRAY);
+        profiler::forEachEvent(*ring, s.previousFrameStart, [&](const profiler::EventCopy& event) {
+            if (event.start >= s.frameStart || event.depth >= maxDepth)
+                return;
+            const float x0 = std::max(0.0f, static_cast<float>(event.start - s.previousFrameStart) / nsPerPixel);
+            const float x1 = static_cast<float>(event.end - s.previousFrameStart) / nsPerPixel;
+            const int width = std::max(1, static_cast<int>(x1 - x0));
+            const int y = top + event.depth * rowHeight;
+            target.rectangle(static_cast<int>(x0), y, width, rowHeight - 1, profiler::colorFor(event.name));
+            if (width > 40)
+                target.text(event.name, static_cast<int>(x0) + 2, y + 1, 8, BLACK);
+        });
+    }
+    char counters[160];
+    snprintf(counters, sizeof(counters), "frame %.2f ms, %lld triangles, %lld lines, %lld projected vertices",
+        static_cast<double>(s.frameStart - s.previousFrameStart) / 1e6,
+        s.frameCounters[static_cast<int>(ProfileCounter::Triangles)],
+        s.frameCounters[static_cast<int>(ProfileCounter::Lines)],
+        s.frameCounters[static_cast<int>(ProfileCounter::ProjectedVertices)]);
+    target.text(counters, 4, std::max(bandsTop, target.height() - 20), 10, WHITE);
+}
+
+// Everything still in the rings, as Chrome trace JSON. Returns false with a message on failure.
+inline bool writeChromeTrace(const char* path, std::string& error)
+{
+    std::ofstream file(path);
+    if (!file) {
+        error = std::string("cannot write ") + path;
+        return false;
+    }
+    profiler::State& s = profiler::state();
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    const int numRings = std::min(s.numRings.load(std::memory_order_acquire), profiler::maxThreads);
+    for (int rr = 0; rr < numRings; ++rr) {
+        profiler::Ring* ring = s.rings[rr].load(std::memory_order_acquire);
+        if (!ring)
+            continue;
+        file << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << rr
+            << ",\"args\":{\"name\":\"" << ring->threadName.load(std::memory_order_relaxed) << "\"}}";
+        first = false;
+        profiler::forEachEvent(*ring, 0, [&](const profiler::EventCopy& event) {
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << rr
+                << ",\"ts\":" << event.start / 1000 << "." << (event.start / 100) % 10
+                << ",\"dur\":" << (event.end - event.start) / 1000 << "." << ((event.end - event.start) / 100) % 10 << "}";
+        });
+    }
+    file << "\n]}\n";
+    if (!file) {
+        error = std::string("error writing ") + path;
+        return false;
+    }
+    return true;
+}
+
+#else
+
+#define PROFILE_SCOPE(name) do {} while (0)
+#define PROFILE_COUNT(counter, n) do {} while (0)
+#define PROFILE_THREAD(name) do {} while (0)
+
+inline void profileFrame() {}
+inline void toggleProfileOverlay() {}
+inline void drawProfileOverlay() {}
+
+inline bool writeChromeTrace(const char*, std::string& error)
+{
+    error = "built without PIXIN_PROFILE";
+    return false;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+// Small deterministic generator (xorshift32). Level generation and every particle emitter own
+// one, so a level and everything that happens in it can be reproduced from a seed, independent
+// of the shared rand() state and of the order compilers evaluate arguments in.
+class Random
+{
+public:
+    explicit Random(uint32_t seed = 0x9E3779B9u) : state(seed ? seed : 1u) {}
+
+    // Scrambles the seed first so that nearby seeds (1, 2, 3...) give unrelated sequences.
+    void reseed(uint32_t seed) {
+        seed ^= seed >> 16;
+        seed *= 0x85EBCA6Bu;
+        seed ^= seed >> 13;
+        seed *= 0xC2B2AE35u;
+        seed ^= seed >> 16;
+        state = seed ? seed : 1u;
+    }
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    // uniform in [0, 1]
+    float unit() { return static_cast<float>(next() >> 8) * (1.0f / 16777215.0f); }
+    float range(float lo, float hi) { return lo + (hi - lo) * unit(); }
+    // uniform in [lo, hi], like GetRandomValue()
+    int rangeInt(int lo, int hi) {
+        if (lo > hi)
+            std::swap(lo, hi);
+        return lo + static_cast<int>(next() % (static_cast<uint32_t>(hi - lo) + 1u));
+    }
+
+    uint32_t state;
+};
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Input.h"
+
+// State visitors. Anything with sim state exposes
+//
+//    template<typename Visitor> void visitState(Visitor& visit)
+//
+// which calls visit(field) for every field that changes during play and visit.array(values, count)
+// for runs of them. That one function then saves, restores and hashes the state. Fields must be
+// plain data; the bytes are stored as they are in memory, so saved state only loads on a machine
+// with the same endianness.
+class StateWriter
+{
+public:
+    explicit StateWriter(std::vector<unsigned char>& out) : out(out) {}
+
+    template<typename T>
+    void operator()(const T& value) { array(&value, 1); }
+
+    template<typename T>
+    void array(const T* values, int count) {
+        static_assert(std::is_trivially_copyable<T>::value, "sim state must be plain data");
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+        out.insert(out.end(), bytes, bytes + sizeof(T) * size_t(count));
+    }
+
+private:
+    std::vector<unsigned char>& out;
+};
+
+class StateReader
+{
+public:
+    StateReader(const unsigned char* data, size_t size) : data(data), size(size), offset(0), ok(true) {}
+
+    template<typename T>
+    void operator()(T& value) { array(&value, 1); }
+
+    template<typename T>
+    void array(T* values, int count) {
+        static_assert(std::is_trivially_copyable<T>::value, "sim state must be plain data");
+        const size_t bytes = sizeof(T) * size_t(count);
+        if (!ok || bytes > size - offset) {
+            ok = false;
+            return;
+        }
+        memcpy(values, data + offset, bytes);
+        offset += bytes;
+    }
+
+    // true when every byte was consumed and nothing was missing
+    bool complete() const { return ok && offset == size; }
+
+private:
+    const unsigned char* data;
+    size_t size;
+    size_t offset;
+    bool ok;
+};
+
+// FNV-1a over the state bytes
+class StateHasher
+{
+public:
+    StateHasher() : hash(14695981039346656037ull) {}
+
+    template<typename T>
+    void operator()(const T& value) { array(&value, 1); }
+
+    template<typename T>
+    void array(const T* values, int count) {
+        static_assert(std::is_trivially_copyable<T>::value, "sim state must be plain data");
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+        const size_t numBytes = sizeof(T) * size_t(count);
+        for (size_t ii = 0; ii < numBytes; ++ii) {
+            hash = (hash ^ bytes[ii]) * 1099511628211ull;
+        }
+    }
+
+    uint32_t value() const { return static_cast<uint32_t>(hash ^ (hash >> 32)); }
+
+private:
+    uint64_t hash;
+};
+
+template<typename Game>
+uint32_t hashState(Game& game)
+{
+    StateHasher hasher;
+    game.visitState(hasher);
+    return hasher.value();
+}
+
+// A recorded play session: what the level was generated from, the input of every tick, a hash of
+// the state after every tick and full state keyframes every keyframeInterval ticks.
+//
+// On disk the input is delta encoded as runs of identical ticks, each run storing how the held
+// buttons changed from the previous run; a session where the player holds a direction for
+// seconds at a time costs a few bytes per second.
+class Replay
+{
+public:
+    typedef struct Keyframe {
+        int tick;       // state before this tick ran
+        size_t offset;  // into keyframeData
+        size_t size;
+    } Keyframe;
+
+    Replay()
+        : level(0)
+        , seed(0)
+        , controls(0)
+        , keyframeInterval(300)
+    {
+    }
+
+    int numTicks() const { return static_cast<int>(inputs.size()); }
+
+    // latest keyframe at or before tick; there is always one for tick 0
+    const Keyframe& keyframeAtOrBefore(int tick) const {
+        auto it = std::upper_bound(keyframes.begin(), keyframes.end(), tick,
+            [](int tt, const Keyframe& keyframe) { return tt < keyframe.tick; });
+        return *(it == keyframes.begin() ? it : it - 1);
+    }
+
+    bool save(const char* path, std::string& error) const {
+        std::vector<unsigned char> out;
+        put32(out, magic);
+        put32(out, version);
+        put32(out, static_cast<uint32_t>(level));
+        put32(out, seed);
+        put32(out, controls);
+        put32(out, static_cast<uint32_t>(keyframeInterval));
+        put32(out, static_cast<uint32_t>(numTicks()));
+
+        uint32_t lastHeld = 0;
+        for (int tt = 0; tt < numTicks();) {
+            int run = 1;
+            while (tt + run < numTicks() && inputs[tt + run].held == inputs[tt].held && inputs[tt + run].pressed == inputs[tt].pressed)
+                ++run;
+            putVarint(out, static_cast<uint32_t>(run));
+            putVarint(out, inputs[tt].held ^ lastHeld);
+            putVarint(out, inputs[tt].pressed);
+            lastHeld = inputs[tt].held;
+            tt += run;
+        }
+        for (uint32_t hash : hashes) {
+            put32(out, hash);
+        }
+        putVarint(out, static_cast<uint32_t>(keyframes.size()));
+        for (const auto& keyframe : keyframes) {
+            putVarint(out, static_cast<uint32_t>(keyframe.tick));
+            putVarint(out, static_cast<uint32_t>(keyframe.size));
+            out.insert(out.end(), keyframeData.begin() + keyframe.offset, keyframeData.begin() + keyframe.offset + keyframe.size);
+        }
+
+        std::ofstream file(path, std::ios::binary);
+        if (!file.write(reinterpret_cast<const char*>(out.data()), out.size())) {
+            error = std::string("cannot write ") + path;
+            return false;
+        }
+        return true;
+    }
+
+    bool load(const char* path, std::string& error) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            error = std::string("cannot open ") + path;
+            return false;
+        }
+        const std::vector<unsigned char> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        size_t at = 0;
+        uint32_t fileMagic = 0, fileVersion = 0, fileLevel = 0, fileInterval = 0, fileTicks = 0;
+        if (!get32(in, at, fileMagic) || fileMagic != magic || !get32(in, at, fileVersion) || fileVersion != version) {
+            error = std::string(path) + " is not a replay from this version";
+            return false;
+        }
+        bool ok = get32(in, at, fileLevel) && get32(in, at, seed) && get32(in, at, controls)
+            && get32(in, at, fileInterval) && get32(in, at, fileTicks) && fileInterval > 0
+            && fileTicks <= in.size() / 4; // every tick stores a hash
+        level = static_cast<int>(fileLevel);
+        keyframeInterval = static_cast<int>(fileInterval);
+
+        inputs.clear();
+        uint32_t held = 0;
+        while (ok && inputs.size() < fileTicks) {
+            uint32_t run = 0, heldDelta = 0, pressed = 0;
+            ok = getVarint(in, at, run) && getVarint(in, at, heldDelta) && getVarint(in, at, pressed)
+                && run > 0 && run <= fileTicks - inputs.size();
+            held ^= heldDelta;
+            if (ok)
+                inputs.insert(inputs.end(), run, InputFrame{ held, pressed });
+        }
+        hashes.resize(ok ? fileTicks : 0);
+        for (size_t tt = 0; ok && tt < hashes.size(); ++tt) {
+            ok = get32(in, at, hashes[tt]);
+        }
+
+        keyframes.clear();
+        keyframeData.clear();
+        uint32_t numKeyframes = 0;
+        ok = ok && getVarint(in, at, numKeyframes);
+        for (uint32_t kk = 0; ok && kk < numKeyframes; ++kk) {
+            uint32_t tick = 0, size = 0;
+            ok = getVarint(in, at, tick) && getVarint(in, at, size) && size <= in.size() - at
+                && tick <= fileTicks && (keyframes.empty() ? tick == 0 : int(tick) > keyframes.back().tick);
+            if (ok) {
+                keyframes.push_back({ static_cast<int>(tick), keyframeData.size(), size });
+                keyframeData.insert(keyframeData.end(), in.begin() + at, in.begin() + at + size);
+                at += size;
+            }
+        }
+        if (!ok || keyframes.empty()) {
+            error = std::string(path) + " is truncated or corrupt";
+            return false;
+        }
+        return true;
+    }
+
+    int level;
+    uint32_t seed;
+    uint32_t controls;      // game specific flags the level was played with
+    int keyframeInterval;
+    std::vector<InputFrame> inputs; // inputs[t] drove tick t
+    std::vector<uint32_t> hashes;   // state hash after tick t
+    std::vector<Keyframe> keyframes;
+    std::vector<unsigned char> keyframeData;
+
+private:
+    static const uint32_t magic = 0x50525850; // "PXRP"
+    static const uint32_t version = 2;
+
+    static void put32(std::vector<unsigned char>& out, uint32_t value) {
+        for (int ii = 0; ii < 4; ++ii) {
+            out.push_back(static_cast<unsigned char>(value >> (8 * ii)));
+        }
+    }
+    static void putVarint(std::vector<unsigned char>& out, uint32_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(value));
+    }
+    static bool get32(const std::vector<unsigned char>& in, size_t& at, uint32_t& value) {
+        if (in.size() - at < 4)
+            return false;
+        value = 0;
+        for (int ii = 0; ii < 4; ++ii) {
+            value |= uint32_t(in[at++]) << (8 * ii);
+        }
+        return true;
+    }
+    static bool getVarint(const std::vector<unsigned char>& in, size_t& at, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35 && at < in.size(); shift += 7) {
+            const unsigned char byte = in[at++];
+            value |= uint32_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+};
+
+// Records a game into a replay. Construct right after the game is created, then call record()
+// with the input of every tick after the game simulated it.
+template<typename Game>
+class ReplayRecorder
+{
+public:
+    ReplayRecorder(Game& game, Replay& replay)
+        : game(game)
+        , replay(replay)
+    {
+        addKeyframe();
+    }
+
+    void record(const InputFrame& input) {
+        replay.inputs.push_back(input);
+        replay.hashes.push_back(hashState(game));
+        if (replay.numTicks() % replay.keyframeInterval == 0)
+            addKeyframe();
+    }
+
+    // drops every tick after tick, for when the game was rewound to the state it had then
+    void truncate(int tick) {
+        if (tick >= replay.numTicks())
+            return;
+        replay.inputs.resize(tick);
+        replay.hashes.resize(tick);
+        while (replay.keyframes.back().tick > tick) {
+            replay.keyframeData.resize(replay.keyframes.back().offset);
+            replay.keyframes.pop_back();
+        }
+    }
+
+private:
+    void addKeyframe() {
+        const size_t offset = replay.keyframeData.size();
+        StateWriter writer(replay.keyframeData);
+        game.visitState(writer);
+        replay.keyframes.push_back({ replay.numTicks(), offset, replay.keyframeData.size() - offset });
+    }
+
+    Game& game;
+    Replay& replay;
+};
+
+// Plays a replay back into a game generated from the same level and seed, checking the state hash
+// after every tick. Call seek(0) before the first step().
+template<typename Game>
+class ReplayPlayer
+{
+public:
+    ReplayPlayer(Game& game, const Replay& replay, float simTimeSeconds)
+        : desyncTick(-1)
+        , game(game)
+        , replay(replay)
+        , simTimeSeconds(simTimeSeconds)
+        , tick(0)
+    {
+    }
+
+    int currentTick() const { return tick; }
+    bool finished() const { return tick >= replay.numTicks(); }
+
+    // runs the next recorded tick; false when the state no longer matches the recording
+    bool step() {
+        game.Sim(simTimeSeconds, replay.inputs[tick]);
+        const bool inSync = hashState(game) == replay.hashes[tick];
+        if (!inSync && desyncTick < 0)
+            desyncTick = tick;
+        ++tick;
+        return inSync;
+    }
+
+    // Puts the game in the state it had before tick target ran: restores the nearest keyframe at or
+    // before it and simulates the rest. False if the keyframe does not fit the game or a tick on the
+    // way desynced.
+    bool seek(int target) {
+        target = std::max(0, std::min(target, replay.numTicks()));
+        const Replay::Keyframe& keyframe = replay.keyframeAtOrBefore(target);
+        StateReader reader(replay.keyframeData.data() + keyframe.offset, keyframe.size);
+        game.visitState(reader);
+        if (!reader.complete())
+            return false;
+        tick = keyframe.tick;
+        bool inSync = true;
+        while (tick < target) {
+            inSync = step() && inSync;
+        }
+        return inSync;
+    }
+
+    int desyncTick; // first tick whose hash did not match, -1 if none
+
+private:
+    Game& game;
+    const Replay& replay;
+    float simTimeSeconds;
+    int tick;
+};
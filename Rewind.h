@@ -0,0 +1,298 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "Replay.h"
+
+// Rewind history for live play, kept inside a fixed memory budget.
+//
+// Game state is split in two. Gameplay state (player, speeds, flags, ticks) is small and is stored
+// for every tick as a delta against the tick before: XOR with the previous bytes, then runs of zero
+// bytes collapsed, which leaves a few bytes for a typical tick. Effects state (particle pools)
+// changes completely every tick, so it is only kept in the full snapshots taken every
+// snapshotInterval ticks; restoring a tick between snapshots has the game step its effects forward
+// from the snapshot, driven by the gameplay state of each tick.
+//
+// A snapshot and the deltas after it form a segment. Records go into one ring of budget bytes and
+// when it is full the oldest segment is dropped, so history reaches back as far as the budget
+// allows. Nothing allocates after construction unless the number of segments grows past anything
+// seen before.
+//
+// Game provides visitGameplayState(visitor), visitEffectsState(visitor), an EffectsCue type with
+// effectsCue() and stepEffects(cue) (see LevelGameState).
+template<typename Game>
+class RewindBuffer
+{
+public:
+    RewindBuffer(Game& game, size_t budgetBytes = 4 * 1024 * 1024, int snapshotInterval = 60)
+        : game(game)
+        , capacity(std::max(budgetBytes, size_t(1024)))
+        , ring(new unsigned char[capacity])
+        , snapshotInterval(std::max(1, snapshotInterval))
+    {
+        segments.resize(64);
+        reset();
+    }
+
+    RewindBuffer(const RewindBuffer&) = delete;
+    RewindBuffer& operator=(const RewindBuffer&) = delete;
+
+    // forget all history and start over from the current state as tick 0
+    void reset() {
+        firstSegment = 0;
+        numSegments = 0;
+        writeOffset = 0;
+        usedBytes = 0;
+        newest = 0;
+        captureGameplay(previousGameplay);
+        writeSnapshot(previousGameplay);
+    }
+
+    int oldestTick() const { return numSegments ? segment(0).firstTick : newest; }
+    int newestTick() const { return newest; }
+    size_t bytesUsed() const { return usedBytes; }
+
+    // call once after every simulated tick
+    void record() {
+        ++newest;
+        captureGameplay(gameplay);
+        if (!numSegments || segment(numSegments - 1).numTicks >= snapshotInterval) {
+            writeSnapshot(gameplay);
+        }
+        else {
+            encodeDelta(previousGameplay, gameplay, scratch);
+            if (writeRecord(scratch.data(), scratch.size())) {
+                ++segment(numSegments - 1).numTicks;
+            }
+            else {
+                writeSnapshot(gameplay); // the current segment alone fills the budget, start a new one
+            }
+        }
+        previousGameplay.swap(gameplay);
+    }
+
+    // Restores the game to tick target (clamped to the history held) and forgets every tick after
+    // it, so play continues from there. Returns the tick restored.
+    int rewindTo(int target) {
+        if (!numSegments)
+            return newest;
+        target = std::max(oldestTick(), std::min(target, newest));
+        size_t index = numSegments - 1;
+        while (segment(index).firstTick > target) {
+            --index;
+        }
+        Segment& seg = segment(index);
+
+        size_t offset = seg.offset;
+        size_t bytes = 0;
+        const unsigned char* payload = nullptr;
+        uint32_t size = 0;
+        offset = readRecord(offset, payload, size, bytes);
+        uint32_t gameplaySize = 0;
+        memcpy(&gameplaySize, payload, sizeof(gameplaySize));
+        previousGameplay.assign(payload + sizeof(gameplaySize), payload + sizeof(gameplaySize) + gameplaySize);
+        {
+            StateReader reader(previousGameplay.data(), previousGameplay.size());
+            game.visitGameplayState(reader);
+        }
+        {
+            const size_t effectsStart = sizeof(gameplaySize) + gameplaySize;
+            StateReader reader(payload + effectsStart, size - effectsStart);
+            game.visitEffectsState(reader);
+        }
+
+        for (int tick = seg.firstTick + 1; tick <= target; ++tick) {
+            offset = readRecord(offset, payload, size, bytes);
+            applyDelta(payload, size, previousGameplay);
+            const typename Game::EffectsCue cue = game.effectsCue();
+            StateReader reader(previousGameplay.data(), previousGameplay.size());
+            game.visitGameplayState(reader);
+            game.stepEffects(cue);
+        }
+
+        // everything after target is gone
+        usedBytes -= seg.bytes - bytes;
+        for (size_t later = index + 1; later < numSegments; ++later) {
+            usedBytes -= segment(later).bytes;
+        }
+        seg.bytes = bytes;
+        seg.numTicks = target - seg.firstTick + 1;
+        numSegments = index + 1;
+        writeOffset = offset;
+        newest = target;
+        return newest;
+    }
+
+private:
+    typedef struct Segment {
+        int firstTick;  // tick of the snapshot
+        int numTicks;   // snapshot plus deltas
+        size_t offset;  // of the snapshot record in the ring
+        size_t bytes;   // ring bytes taken, wrap padding included
+    } Segment;
+
+    static const uint32_t padMarker = 0xffffffffu;
+
+    Segment& segment(size_t index) { return segments[(firstSegment + index) % segments.size()]; }
+    const Segment& segment(size_t index) const { return segments[(firstSegment + index) % segments.size()]; }
+
+    void captureGameplay(std::vector<unsigned char>& out) {
+        out.clear();
+        StateWriter writer(out);
+        game.visitGameplayState(writer);
+    }
+
+    // starts a segment; the payload is the gameplay size, the gameplay bytes and the effects bytes
+    void writeSnapshot(const std::vector<unsigned char>& gameplayBytes) {
+        const uint32_t gameplaySize = static_cast<uint32_t>(gameplayBytes.size());
+        scratch.resize(sizeof(gameplaySize));
+        memcpy(scratch.data(), &gameplaySize, sizeof(gameplaySize));
+        scratch.insert(scratch.end(), gameplayBytes.begin(), gameplayBytes.end());
+        StateWriter writer(scratch);
+        game.visitEffectsState(writer);
+
+        if (numSegments == segments.size()) {
+            // grow the segment ring, keeping order
+            std::vector<Segment> grown(segments.size() * 2);
+            for (size_t ii = 0; ii < numSegments; ++ii) {
+                grown[ii] = segment(ii);
+            }
+            segments.swap(grown);
+            firstSegment = 0;
+        }
+        const size_t offset = writeOffset;
+        ++numSegments;
+        Segment& seg = segment(numSegments - 1);
+        seg.firstTick = newest;
+        seg.numTicks = 1;
+        seg.offset = offset;
+        seg.bytes = 0;
+        if (!writeRecord(scratch.data(), scratch.size())) {
+            // a single snapshot is over budget; keep no history rather than a broken one
+            numSegments = 0;
+            usedBytes = 0;
+        }
+    }
+
+    // Appends a record to the newest segment, dropping older segments to make room.
+    bool writeRecord(const unsigned char* payload, size_t size) {
+        const size_t need = sizeof(uint32_t) + size;
+        if (need > capacity)
+            return false;
+        size_t pos = writeOffset;
+        size_t pad = 0;
+        if (capacity - pos < need) {
+            pad = capacity - pos;
+            pos = 0;
+        }
+        while (capacity - usedBytes < pad + need) {
+            if (numSegments <= 1)
+                return false;
+            usedBytes -= segment(0).bytes;
+            firstSegment = (firstSegment + 1) % segments.size();
+            --numSegments;
+        }
+        if (pad >= sizeof(uint32_t)) {
+            const uint32_t marker = padMarker;
+            memcpy(&ring[writeOffset], &marker, sizeof(marker));
+        }
+        const uint32_t size32 = static_cast<uint32_t>(size);
+        memcpy(&ring[pos], &size32, sizeof(size32));
+        memcpy(&ring[pos + sizeof(size32)], payload, size);
+        writeOffset = pos + need;
+        usedBytes += pad + need;
+        segment(numSegments - 1).bytes += pad + need;
+        return true;
+    }
+
+    // returns the offset after the record and adds the bytes it took to consumed
+    size_t readRecord(size_t offset, const unsigned char*& payload, uint32_t& size, size_t& consumed) const {
+        if (capacity - offset < sizeof(uint32_t)) {
+            consumed += capacity - offset;
+            offset = 0;
+        }
+        memcpy(&size, &ring[offset], sizeof(size));
+        if (size == padMarker) {
+            consumed += capacity - offset;
+            offset = 0;
+            memcpy(&size, &ring[offset], sizeof(size));
+        }
+        payload = &ring[offset + sizeof(size)];
+        consumed += sizeof(size) + size;
+        return offset + sizeof(size) + size;
+    }
+
+    // XOR against the previous tick as (zero run, literal run, literal bytes) varint groups
+    static void encodeDelta(const std::vector<unsigned char>& before, const std::vector<unsigned char>& after, std::vector<unsigned char>& out) {
+        out.clear();
+        const size_t size = after.size();
+        size_t ii = 0;
+        while (ii < size) {
+            size_t zeros = ii;
+            while (zeros < size && before[zeros] == after[zeros]) {
+                ++zeros;
+            }
+            if (zeros == size)
+                break;
+            size_t literals = zeros;
+            while (literals < size && before[literals] != after[literals]) {
+                ++literals;
+            }
+            putVarint(out, zeros - ii);
+            putVarint(out, literals - zeros);
+            for (size_t jj = zeros; jj < literals; ++jj) {
+                out.push_back(before[jj] ^ after[jj]);
+            }
+            ii = literals;
+        }
+    }
+
+    static void applyDelta(const unsigned char* delta, size_t size, std::vector<unsigned char>& state) {
+        size_t at = 0;
+        size_t ii = 0;
+        while (at < size) {
+            ii += getVarint(delta, at);
+            const size_t literals = getVarint(delta, at);
+            for (size_t jj = 0; jj < literals; ++jj) {
+                state[ii++] ^= delta[at++];
+            }
+        }
+    }
+
+    static void putVarint(std::vector<unsigned char>& out, size_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    static size_t getVarint(const unsigned char* in, size_t& at) {
+        size_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            const unsigned char byte = in[at++];
+            value |= size_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+    }
+
+    Game& game;
+    size_t capacity;
+    std::unique_ptr<unsigned char[]> ring;
+    int snapshotInterval;
+    size_t writeOffset;
+    size_t usedBytes;
+    int newest;
+
+    std::vector<Segment> segments; // ring of numSegments starting at firstSegment
+    size_t firstSegment;
+    size_t numSegments;
+
+    std::vector<unsigned char> previousGameplay;
+    std::vector<unsigned char> gameplay;
+    std::vector<unsigned char> scratch;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#include "Input.h"
+#include "Profiler.h"
+#include "Replay.h"
+
+// Runs a game's ticks at a fixed rate on a thread of its own, so the game plays at the same speed
+// whatever the frame rate and a slow frame never holds the simulation up.
+//
+// The render thread hands over input with submit() and calls present() once per frame. After every
+// tick the sim thread writes the whole state (visitState) into one of three buffers and publishes it
+// with a single atomic exchange; present() takes the newest one, loads it into a second copy of the
+// game used only for drawing, and interpolates the player between the last two ticks. Neither side
+// ever waits for the other.
+//
+// Game provides visitState(visitor), finished, and a Pose with pose(), setPose(pose) and
+// interpolatePose(from, to, t). Without threads (emscripten) the ticks run inside present() instead.
+template<typename Game>
+class SimThread
+{
+public:
+    typedef std::function<void(const InputFrame&)> StepFunction;
+
+    // step advances game by one tick; it runs on the sim thread, as does everything it touches.
+    SimThread(Game& game, int ticksPerSecond, StepFunction step)
+        : game(game)
+        , step(std::move(step))
+        , period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / std::max(1, ticksPerSecond))))
+        , start(Clock::now())
+        , nextTick(start)
+        , held(0)
+        , pressed(0)
+        , back(0)
+        , middle(1)
+        , front(2)
+        , stopping(false)
+        , presentedPose(game.pose())
+        , previousPose(presentedPose)
+        , presentedTime(0.0)
+    {
+#if !defined(__EMSCRIPTEN__)
+        thread = std::thread([this] { run(); });
+#endif
+    }
+
+    ~SimThread()
+    {
+        stopping.store(true, std::memory_order_relaxed);
+        if (thread.joinable())
+            thread.join();
+    }
+
+    SimThread(const SimThread&) = delete;
+    SimThread& operator=(const SimThread&) = delete;
+
+    // input for the next tick; presses are kept until a tick sees them
+    void submit(const InputFrame& input) {
+        held.store(input.held, std::memory_order_relaxed);
+        pressed.fetch_or(input.pressed, std::memory_order_relaxed);
+    }
+
+    // Brings view up to date with the newest tick and moves its player to where it is now, between
+    // the last two ticks. Returns false if no tick has run yet.
+    bool present(Game& view) {
+        PROFILE_SCOPE("SimThread::present");
+#if defined(__EMSCRIPTEN__)
+        runDueTicks();
+#endif
+        if (middle.load(std::memory_order_relaxed) & freshBit) {
+            front = middle.exchange(front, std::memory_order_acq_rel) & indexMask;
+            const Snapshot& snapshot = buffers[front];
+            StateReader reader(snapshot.state.data(), snapshot.state.size());
+            view.visitState(reader);
+            previousPose = snapshot.previousPose;
+            presentedPose = view.pose();
+            presentedTime = snapshot.time;
+            presentedAny = true;
+        }
+        if (!presentedAny)
+            return false;
+        const double ticks = (secondsSinceStart(Clock::now()) - presentedTime) / std::chrono::duration<double>(period).count();
+        const float t = static_cast<float>(std::min(1.0, std::max(0.0, ticks)));
+        view.setPose(view.interpolatePose(previousPose, presentedPose, t));
+        return true;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    typedef struct Snapshot {
+        std::vector<unsigned char> state;
+        typename Game::Pose previousPose; // before the tick
+        double time;                      // when the tick was due, in seconds since start
+    } Snapshot;
+
+    static const int freshBit = 4;   // middle holds a snapshot present() has not taken yet
+    static const int indexMask = 3;
+    static const int maxCatchUp = 5; // ticks run back to back after a stall before skipping ahead
+
+    void run() {
+        PROFILE_THREAD("sim");
+        while (!stopping.load(std::memory_order_relaxed) && !game.finished) {
+            std::this_thread::sleep_until(nextTick);
+            runDueTicks();
+        }
+    }
+
+    void runDueTicks() {
+        const Clock::time_point now = Clock::now();
+        for (int ii = 0; ii < maxCatchUp && nextTick <= now && !game.finished; ++ii) {
+            tick();
+            nextTick += period;
+        }
+        if (nextTick <= now)
+            nextTick = now; // stalled for too long (debugger, suspend); drop the backlog
+    }
+
+    void tick() {
+        PROFILE_SCOPE("SimThread::tick");
+        const InputFrame input = { held.load(std::memory_order_relaxed), pressed.exchange(0, std::memory_order_relaxed) };
+        Snapshot& snapshot = buffers[back];
+        snapshot.previousPose = game.pose();
+        step(input);
+        snapshot.time = secondsSinceStart(nextTick);
+        snapshot.state.clear();
+        StateWriter writer(snapshot.state);
+        game.visitState(writer);
+        back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    double secondsSinceStart(Clock::time_point time) const {
+        return std::chrono::duration<double>(time - start).count();
+    }
+
+    Game& game;
+    StepFunction step;
+    const Clock::duration period;
+    const Clock::time_point start;
+    Clock::time_point nextTick; // sim thread only
+
+    std::atomic<uint32_t> held;
+    std::atomic<uint32_t> pressed;
+
+    // triple buffer: the sim thread writes back, present() reads front, middle is passed between them
+    Snapshot buffers[3];
+    int back;
+    std::atomic<int> middle;
+    int front;
+
+    std::atomic<bool> stopping;
+    std::thread thread;
+
+    // present() only
+    typename Game::Pose presentedPose;
+    typename Game::Pose previousPose;
+    double presentedTime;
+    bool presentedAny = false;
+};
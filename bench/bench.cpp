@@ -0,0 +1,431 @@
+/*******************************************************************************************
+* Microbenchmarks for the hot paths of the game, on fixed seeds so that runs compare across builds.
+*
+*     pixin_bench [--filter TEXT] [--min-time MS] [--samples N] [--out FILE]
+*
+* Every benchmark is timed in samples of as many iterations as it takes to last min-time. The
+* report is JSON on stdout (or FILE): per benchmark the iterations per sample, the items one
+* iteration covers, and the median, fastest and slowest sample in nanoseconds per iteration.
+* Progress goes to stderr.
+*
+* Nothing here opens a window. Drawing goes to a SoftwareCanvas, which rasterizes on the CPU; the
+* render/ benchmarks count triangles as their items, so items / median_ns gives triangles per ns.
+********************************************************************************************/
+
+#define PIXIN_NO_MAIN
+#include "../main.cpp"
+#include "../Hazards.h"
+
+#include <fstream>
+#include <functional>
+
+namespace {
+
+const uint32_t benchSeed = 1;
+
+typedef struct Benchmark {
+    const char* name;
+    int items;                   // calls, ticks or points one iteration covers
+    std::function<void()> run;   // one iteration
+} Benchmark;
+
+typedef struct Result {
+    const char* name;
+    int items;
+    long long iterations;        // per sample
+    double medianNs;
+    double minNs;
+    double maxNs;
+} Result;
+
+// keeps results alive so the optimizer cannot drop the work
+volatile long long gSink = 0;
+
+typedef std::chrono::steady_clock Clock;
+
+double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+Result measure(const Benchmark& benchmark, double minSeconds, int numSamples)
+{
+    // grow the batch until one sample lasts minSeconds; the calibration runs double as warm up
+    long long iterations = 1;
+    for (;;) {
+        const Clock::time_point start = Clock::now();
+        for (long long ii = 0; ii < iterations; ++ii) {
+            benchmark.run();
+        }
+        const double elapsed = secondsSince(start);
+        if (elapsed >= minSeconds)
+            break;
+        const double wanted = elapsed > 0.0 ? minSeconds / elapsed * 1.2 : 10.0;
+        iterations = std::max(iterations + 1, static_cast<long long>(static_cast<double>(iterations) * std::min(wanted, 10.0)));
+    }
+
+    std::vector<double> samples;
+    for (int ss = 0; ss < numSamples; ++ss) {
+        const Clock::time_point start = Clock::now();
+        for (long long ii = 0; ii < iterations; ++ii) {
+            benchmark.run();
+        }
+        samples.push_back(secondsSince(start) * 1e9 / static_cast<double>(iterations));
+    }
+    std::sort(samples.begin(), samples.end());
+    return Result{ benchmark.name, benchmark.items, iterations, samples[samples.size() / 2], samples.front(), samples.back() };
+}
+
+void clearGeom(LevelGeometry& lg)
+{
+    for (auto& slice : lg.changeShape().geom) {
+        std::fill(slice.begin(), slice.end(), static_cast<unsigned char>(0));
+    }
+}
+
+// The transform LevelGameState::Render sets up, with the player at slice.
+LevelTransformer screenTransform(const LevelGeometry& lg, float slice)
+{
+    LevelTransformer transformer = lg.transformer;
+    transformer.screenCenter = Vector2{ 400.0f, 300.0f };
+    transformer.slicesPerScreen = lg.slicesPerScreen;
+    transformer.sliceAtCenter = slice + lg.slicesBeforePlayer;
+    return transformer;
+}
+
+void writeJson(std::ostream& out, const std::vector<Result>& results, double minSeconds, int numSamples)
+{
+    char line[256];
+    out << "{\n";
+    out << "  \"threads\": " << jobSystem().numThreads() << ",\n";
+    out << "  \"seed\": " << benchSeed << ",\n";
+    out << "  \"min_time_ms\": " << minSeconds * 1000.0 << ",\n";
+    out << "  \"samples\": " << numSamples << ",\n";
+    out << "  \"benchmarks\": [\n";
+    for (size_t ii = 0; ii < results.size(); ++ii) {
+        const Result& result = results[ii];
+        snprintf(line, sizeof(line),
+            "    {\"name\": \"%s\", \"items\": %d, \"iterations\": %lld, \"median_ns\": %.1f, \"min_ns\": %.1f, \"max_ns\": %.1f}%s\n",
+            result.name, result.items, result.iterations, result.medianNs, result.minNs, result.maxNs, ii + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* filter = nullptr;
+    const char* outFile = nullptr;
+    double minSeconds = 0.05;
+    int numSamples = 9;
+    for (int ii = 1; ii < argc; ++ii) {
+        const std::string arg = argv[ii];
+        const bool hasValue = ii + 1 < argc;
+        if (arg == "--filter" && hasValue) filter = argv[++ii];
+        else if (arg == "--min-time" && hasValue) minSeconds = atof(argv[++ii]) / 1000.0;
+        else if (arg == "--samples" && hasValue) numSamples = std::max(1, atoi(argv[++ii]));
+        else if (arg == "--out" && hasValue) outFile = argv[++ii];
+        else {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    // Fixtures. Every level is generated once up front. Generators reseed a scratch level every
+    // iteration so each iteration does the same work; the section generators each fill a grid of
+    // their own, so they do not depend on which benchmarks ran before.
+    LevelGeometry levels[3];
+    for (int level = 0; level < 3; ++level) {
+        levels[level].generate(level, benchSeed);
+    }
+    LevelGeometry scratch;
+    typedef std::vector< std::vector<unsigned char> > Grid;
+    const Grid emptyGrid(200, std::vector<unsigned char>(scratch.sliceSize, 0));
+    Grid mazeGrid = emptyGrid;
+    Grid maze2Grid = emptyGrid;
+    Grid slipGrid = emptyGrid;
+    Grid randoGrid = emptyGrid;
+
+    // open: nothing in the way; maze: the first maze section of level 1 as its generator checks it;
+    // blocked: a full wall halfway, so the search fails after visiting everything before it
+    LevelGeometry open;
+    clearGeom(open);
+    LevelGeometry blocked;
+    clearGeom(blocked);
+    std::vector<unsigned char>& blockingSlice = blocked.changeShape().geom[100];
+    std::fill(blockingSlice.begin(), blockingSlice.end(), static_cast<unsigned char>(255));
+    const int sliceSize = open.sliceSize;
+
+    Random pointRandom(benchSeed);
+    const int numPoints = 4096;
+    std::vector<SimSpacePosition> points;
+    for (int ii = 0; ii < numPoints; ++ii) {
+        points.push_back(SimSpacePosition(pointRandom.range(0.0f, static_cast<float>(levels[1].winningZone)),
+            pointRandom.range(0.0f, static_cast<float>(sliceSize))));
+    }
+
+    const int numRays = 256;
+    std::vector<float> rayAngles;
+    for (int ii = 0; ii < numRays; ++ii) {
+        rayAngles.push_back(pointRandom.range(0.0f, 2.0f * PI));
+    }
+    ClearanceField clearance;
+    // level 1 with a player three cells across
+    LevelGeometry bigShip;
+    bigShip.copyLevel(levels[1]);
+    bigShip.setPlayerFootprint(Footprint::box(3, 3));
+    // level 1 to paint on, with a shape of its own up front so no benchmark times copying it
+    LevelGeometry editing;
+    editing.copyLevel(levels[1]);
+    editing.changeShape();
+
+    // hazards going round level 1 in open places, some across the maze sections, hashed where they
+    // start
+    const int numHazards = 10000;
+    HazardPool hazards(numHazards, sliceSize);
+    CylinderHash hazardHash(sliceSize, numHazards);
+    Random hazardRandom(benchSeed);
+    while (hazards.size() < numHazards) {
+        const float slice = hazardRandom.range(0.0f, static_cast<float>(levels[1].winningZone));
+        const float position = hazardRandom.range(0.0f, static_cast<float>(sliceSize));
+        const float half = hazardRandom.range(0.25f, 1.5f);
+        const int first = static_cast<int>(floorf(position - half));
+        if (!levels[1].shape->walls.boxHasWall(static_cast<int>(floorf(slice - half)), static_cast<int>(floorf(slice + half)), first, static_cast<int>(floorf(position + half)) - first + 1)) {
+            hazards.spawn(slice, position, 0.0f, hazardRandom.range(-1.0f, 1.0f), half, half, 0);
+        }
+    }
+    hazardHash.build(hazards);
+
+    const float viewSlice = 300.0f;
+    const LevelTransformer transformer = screenTransform(levels[1], viewSlice);
+    const int projectedSlices = static_cast<int>(levels[1].slicesPerScreen) + 2;
+
+    const int explosionTicks = 60;
+    const SimSpacePosition explosionOrigin(viewSlice, 100.0f);
+    Explosion explosion;
+    explosion.transform = transformer;
+    auto startExplosion = [&]() {
+        explosion.emitter.random.reseed(benchSeed);
+        explosion.start(explosionOrigin);
+    };
+    Explosion preparedExplosion; // mid flight, when it has the most streaks on screen
+    preparedExplosion.transform = transformer;
+    preparedExplosion.emitter.random.reseed(benchSeed);
+    preparedExplosion.start(explosionOrigin);
+    for (int tick = 0; tick < 30; ++tick) {
+        preparedExplosion.simit(tick);
+    }
+
+    // a level mid play, and the same level dying with the explosion in full flight
+    SoftwareCanvas screen(screenWidth, screenHeight);
+    CanvasScope useScreen(screen);
+    NullAudio audio;
+    LevelGameState playing(audio, 0, benchSeed);
+    LevelGameState dying(audio, 0, benchSeed);
+    TitleScreenGameState title(audio);
+    const InputFrame up = { BUTTON_UP, 0 };
+    for (int tick = 0; tick < 200; ++tick) {
+        frameArena().reset();
+        playing.Sim(1.0f / 60.0f, up);
+        dying.Sim(1.0f / 60.0f, up);
+    }
+    while (!dying.playerDead && !dying.finished) {
+        frameArena().reset();
+        dying.Sim(1.0f / 60.0f, InputFrame{ 0, 0 });
+    }
+    for (int tick = 0; tick < 30; ++tick) {
+        frameArena().reset();
+        dying.Sim(1.0f / 60.0f, InputFrame{ 0, 0 });
+    }
+    // the triangles one frame of each submits
+    auto trianglesPerFrame = [&](GameState& game) {
+        frameArena().reset();
+        game.Render();
+        return static_cast<int>(screen.trianglesDrawn());
+    };
+    const int playingTriangles = trianglesPerFrame(playing);
+    const int dyingTriangles = trianglesPerFrame(dying);
+    const int titleTriangles = trianglesPerFrame(title);
+    NullCanvas nowhere(screenWidth, screenHeight);
+
+    const Benchmark benchmarks[] = {
+        { "havePath/open", 1, [&] {
+            gSink += havePath(GridPosition(0, 0), GridPosition(200, 0), open.shape->geom, sliceSize, 0, 200);
+        } },
+        { "havePath/maze", 1, [&] {
+            gSink += havePath(GridPosition(49, 0), GridPosition(101, 0), levels[1].shape->geom, sliceSize, 49, 101);
+        } },
+        { "havePath/blocked", 1, [&] {
+            gSink += havePath(GridPosition(0, 0), GridPosition(200, 0), blocked.shape->geom, sliceSize, 0, 200);
+        } },
+        { "generateMaze", 1, [&] {
+            scratch.random.reseed(benchSeed);
+            scratch.generateMaze(mazeGrid, 50, 100, 10, 40, 1);
+        } },
+        { "generateMaze2", 1, [&] {
+            scratch.random.reseed(benchSeed);
+            scratch.generateMaze2(maze2Grid, 50, 100, 60, 5, 20);
+        } },
+        { "generateSlip", 1, [&] {
+            ArenaScope scope(generationArena());
+            ArenaVector<int> positions({ 40, 190, 230, 330 }, generationArena());
+            scratch.generateSlip(slipGrid, 50, 100, positions, 40);
+        } },
+        { "generateRandoWithSlip", 1, [&] {
+            scratch.random.reseed(benchSeed);
+            scratch.generateRandoWithSlip(randoGrid, 50, 150, 100, 3, 15);
+        } },
+        { "generateLevel", 1, [&] {
+            scratch.random.reseed(benchSeed);
+            scratch.generateLevel();
+        } },
+        { "generateLevel2", 1, [&] {
+            scratch.random.reseed(benchSeed);
+            scratch.generateLevel2();
+        } },
+        { "generateLevel3", 1, [&] {
+            scratch.random.reseed(benchSeed);
+            scratch.generateLevel3();
+        } },
+        { "LevelAnalysis::analyse", 1, [&] {
+            LevelAnalysis analysis;
+            analysis.analyse(levels[1]);
+            gSink += analysis.pathLength;
+        } },
+        { "collides", numPoints, [&] {
+            long long hits = 0;
+            for (const SimSpacePosition& point : points) {
+                hits += levels[1].collides(point.slice, point.positionInSlice, 0);
+            }
+            gSink += hits;
+        } },
+        { "collides/3x3 footprint", numPoints, [&] {
+            long long hits = 0;
+            for (const SimSpacePosition& point : points) {
+                hits += bigShip.collides(point.slice, point.positionInSlice, 0);
+            }
+            gSink += hits;
+        } },
+        { "sweepSlices/12 cells", numPoints, [&] {
+            long long hits = 0;
+            float impact;
+            for (const SimSpacePosition& point : points) {
+                hits += levels[1].sweepSlices(point.slice, point.positionInSlice, 12.0f, 0, impact);
+            }
+            gSink += hits;
+        } },
+        { "sweepPositions/12 cells", numPoints, [&] {
+            long long hits = 0;
+            float impact;
+            for (const SimSpacePosition& point : points) {
+                hits += levels[1].sweepPositions(point.slice, point.positionInSlice, -12.0f, 0, impact);
+            }
+            gSink += hits;
+        } },
+        { "fillCells/3x3 + applyEdits, and undo", 1, [&] {
+            editing.fillCells(GridPosition(300, 100), GridPosition(302, 102), LevelGeometry::solidCell);
+            editing.endEdit();
+            editing.applyEdits();
+            editing.undoEdit();
+            editing.applyEdits();
+        } },
+        { "HazardPool::step", numHazards, [&] {
+            hazards.step(levels[1].shape->clearance, levels[1].shape->walls, levels[1].shape->phaseWalls, levels[1].solidPhasesAt(0));
+        } },
+        { "CylinderHash::build", numHazards, [&] {
+            hazardHash.build(hazards);
+        } },
+        { "CylinderHash::queryFootprint", numPoints, [&] {
+            long long hits = 0;
+            const Footprint& footprint = levels[1].playerFootprint;
+            for (const SimSpacePosition& point : points) {
+                hazardHash.queryFootprint(hazards, footprint, footprint.firstSlice(point.slice), footprint.firstPosition(point.positionInSlice), [&](int) { ++hits; });
+            }
+            gSink += hits;
+        } },
+        { "ClearanceField::build", 1, [&] {
+            clearance.build(levels[1].shape->geom);
+            gSink += clearance.at(100, 0);
+        } },
+        { "ClearanceField::update", 1, [&] {
+            editing.changeShape().clearance.update(editing.shape->geom, 300, 301);
+        } },
+        { "ClearanceField::raycast", numRays, [&] {
+            float sum = 0.0f;
+            for (int ii = 0; ii < numRays; ++ii) {
+                sum += levels[1].shape->clearance.raycast(points[ii].slice, points[ii].positionInSlice, cosf(rayAngles[ii]), sinf(rayAngles[ii]), 200.0f);
+            }
+            gSink += static_cast<long long>(sum);
+        } },
+        { "simToWorld+worldToScreen", projectedSlices * (sliceSize + 1), [&] {
+            float sum = 0.0f;
+            for (int ii = 0; ii < projectedSlices; ++ii) {
+                const float slice = transformer.sliceAtCenter - static_cast<float>(ii);
+                for (int jj = 0; jj <= sliceSize; ++jj) {
+                    const Vector2 screen = transformer.worldToScreen(transformer.simToWorld(slice, jj));
+                    sum += screen.x + screen.y;
+                }
+            }
+            gSink += static_cast<long long>(sum);
+        } },
+        { "updateWorldGeom", 1, [&] {
+            editing.updateWorldGeom();
+        } },
+        { "Explosion::simit", explosionTicks, [&] {
+            startExplosion();
+            for (int tick = 0; tick < explosionTicks; ++tick) {
+                explosion.simit(tick);
+            }
+            gSink += explosion.particles.size();
+        } },
+        { "Explosion::prepare", 1, [&] {
+            frameArena().reset();
+            preparedExplosion.prepare();
+            gSink += static_cast<long long>(preparedExplosion.prepared().lines.size());
+        } },
+        { "render/level", playingTriangles, [&] {
+            frameArena().reset();
+            playing.Render();
+            gSink += screen.pixel(screenWidth / 2, screenHeight / 2).r;
+        } },
+        { "render/level/submit only", playingTriangles, [&] {
+            CanvasScope discard(nowhere);
+            frameArena().reset();
+            playing.Render();
+        } },
+        { "render/explosion", dyingTriangles, [&] {
+            frameArena().reset();
+            dying.Render();
+            gSink += screen.pixel(screenWidth / 2, screenHeight / 2).r;
+        } },
+        { "render/title", titleTriangles, [&] {
+            frameArena().reset();
+            title.Render();
+            gSink += screen.pixel(screenWidth / 2, screenHeight / 2).r;
+        } },
+    };
+
+    std::vector<Result> results;
+    for (const Benchmark& benchmark : benchmarks) {
+        if (filter && !strstr(benchmark.name, filter))
+            continue;
+        const Result result = measure(benchmark, minSeconds, numSamples);
+        std::cerr << result.name << ": " << result.medianNs / 1000.0 << " us per iteration (" << result.iterations << " per sample)" << std::endl;
+        results.push_back(result);
+    }
+
+    if (outFile) {
+        std::ofstream file(outFile);
+        writeJson(file, results, minSeconds, numSamples);
+        if (!file) {
+            std::cerr << "cannot write " << outFile << std::endl;
+            return 1;
+        }
+    }
+    else {
+        writeJson(std::cout, results, minSeconds, numSamples);
+    }
+    return 0;
+}
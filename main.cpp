@@ -11,23 +11,114 @@
 * Intro screen
 * Momentum for play
 * 
-* emcc main2.cpp -s WASM=1 -o pixin.html -L lib -I include -l raylib -s USE_GLFW=3 -s ASYNCIFY
+* emcc main2.cpp -s WASM=1 -o pixin.html -L lib -I include -l raylib -s USE_GLFW=3
 * python -m http.server 7801
 *
 ********************************************************************************************/
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
-#include <thread>
+#include <climits>
 #include <functional>
+#include <thread>
 #include <iostream>
-#include <sstream>
 #include <vector>
 #include <memory>
+#include <new>
 #include <assert.h>
 #include "raylib.h"
 #include "raymath.h"
+#include "Arena.h"
+#include "Audio.h"
+#include "Canvas.h"
+#include "Clearance.h"
+#include "CollisionMask.h"
+#include "DynamicResolution.h"
+#include "FrameStats.h"
+#include "Input.h"
+#include "JobSystem.h"
+#include "MemoryTracker.h"
+#include "Particles.h"
+#include "Profiler.h"
+#include "Random.h"
+#include "Replay.h"
+#include "Rewind.h"
+#include "SimThread.h"
+#if defined(__EMSCRIPTEN__)
+#include <emscripten/emscripten.h>
+#endif
+
+// Every heap allocation in the process is counted so the debug overlay can show allocations per
+// frame, which should stay at zero during normal play, and charged to a memory tag (MemoryTracker.h).
+std::atomic<long long> gHeapAllocations(0);
+long long gFrameAllocations = 0; // during the last complete frame
+
+void* operator new(size_t size)
+{
+    gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* block = std::malloc(memory::heapHeaderSize + size))
+        return tagHeapBlock(block, size);
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    gHeapAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* block = std::malloc(memory::heapHeaderSize + size);
+    return block ? tagHeapBlock(block, size) : nullptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    if (ptr)
+        std::free(untagHeapBlock(ptr));
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    if (ptr)
+        std::free(untagHeapBlock(ptr));
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    if (ptr)
+        std::free(untagHeapBlock(ptr));
+}
 
-int gSimTick = 0;
+// Comparisons between visits to each game state, for the window's session; main thread only.
+MemoryCheckpoints& memoryCheckpoints()
+{
+    static MemoryCheckpoints checkpoints;
+    return checkpoints;
+}
+
+bool gMemoryOverlay = false; // toggled with BUTTON_MEMORY
+
+// Memory by tag in the top right corner, with the last possible leak found under it. Draws after
+// everything else, like drawProfileOverlay().
+void drawMemoryOverlay()
+{
+    if (!gMemoryOverlay)
+        return;
+    Canvas& target = canvas();
+    const MemorySnapshot snapshot = memorySnapshot();
+    const auto& warnings = memoryCheckpoints().allWarnings();
+    const int lineHeight = 12;
+    const int numLines = numMemoryTags + 2;
+    char line[96];
+    const int width = target.measureText(memoryReportLine(snapshot, 0, line, sizeof(line)), 10);
+    const int left = target.width() - width - 8;
+    target.rectangle(left - 4, 0, width + 12, numLines * lineHeight + (warnings.empty() ? 4 : lineHeight + 4), Color{ 0, 0, 0, 180 });
+    for (int ll = 0; memoryReportLine(snapshot, ll, line, sizeof(line)); ++ll) {
+        target.text(line, left, 4 + ll * lineHeight, 10, ll == 0 ? GRAY : WHITE);
+    }
+    if (!warnings.empty()) {
+        const char* last = warnings.back().c_str();
+        target.text(last, target.width() - target.measureText(last, 10) - 8, 4 + numLines * lineHeight, 10, RED);
+    }
+}
 
 class Thing
 {
@@ -52,7 +143,7 @@ public:
 
     virtual void doRender() override
     {
-        DrawCircleV(position, radius, color);
+        canvas().circle(position, radius, color);
     }
 
     Color color;
@@ -61,31 +152,157 @@ public:
 
 
 
+// Appends text and numbers into a fixed buffer; formatting without iostreams or allocations.
+class TextBuilder
+{
+public:
+    TextBuilder() : length(0) { buffer[0] = '\0'; }
+
+    TextBuilder& append(const char* str) {
+        while (*str && length < capacity - 1) {
+            buffer[length++] = *str++;
+        }
+        buffer[length] = '\0';
+        return *this;
+    }
+
+    TextBuilder& append(long long value) {
+        char digits[24];
+        int numDigits = 0;
+        unsigned long long magnitude = value < 0 ? 0ull - static_cast<unsigned long long>(value) : static_cast<unsigned long long>(value);
+        do {
+            digits[numDigits++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude);
+        if (value < 0)
+            digits[numDigits++] = '-';
+        char reversed[24];
+        for (int ii = 0; ii < numDigits; ++ii) {
+            reversed[ii] = digits[numDigits - 1 - ii];
+        }
+        reversed[numDigits] = '\0';
+        return append(reversed);
+    }
+
+    TextBuilder& append(int value) { return append(static_cast<long long>(value)); }
+
+    // fixed point with the given number of decimals
+    TextBuilder& append(float value, int decimals) {
+        long long scale = 1;
+        for (int ii = 0; ii < decimals; ++ii) {
+            scale *= 10;
+        }
+        const long long scaled = llroundf(fabsf(value) * static_cast<float>(scale));
+        if (value < 0.0f && scaled != 0)
+            append("-");
+        append(scaled / scale);
+        if (decimals > 0) {
+            char fraction[24];
+            long long rest = scaled % scale;
+            for (int ii = decimals - 1; ii >= 0; --ii) {
+                fraction[ii] = static_cast<char>('0' + rest % 10);
+                rest /= 10;
+            }
+            fraction[decimals] = '\0';
+            append(".").append(fraction);
+        }
+        return *this;
+    }
+
+    void clear() { length = 0; buffer[0] = '\0'; }
+    const char* c_str() const { return buffer; }
+
+private:
+    static const int capacity = 256;
+    char buffer[capacity];
+    int length;
+};
+
+// Retained text. The string and its glyph layout are kept between frames and only redone when
+// setText() or the font size actually changes something; rendering just replays the cached glyph
+// positions. Matches DrawText() output for the canvas' font.
 class Text : public Thing
 {
 public:
     Text(const Color& color, const Vector2& position = { 0 }, const std::string str = "", int fontSize = 20, bool center = true)
         : Thing(position)
-        , text(str)
         , fontSize(fontSize)
+        , color(color)
         , center(center)
-        , color(color) {}
+        , text(str)
+        , dirty(true)
+        , width(0) {}
+
+    void setText(const char* str) {
+        if (text != str) {
+            text = str;
+            dirty = true;
+        }
+    }
+    void setText(const std::string& str) { setText(str.c_str()); }
+    const std::string& str() const { return text; }
+
+    void setFontSize(int size) {
+        if (fontSize != size) {
+            fontSize = size;
+            dirty = true;
+        }
+    }
 
     virtual void doRender() override
     {
-        if (center) {
-            int width = MeasureText(text.c_str(), fontSize);
-            DrawText(text.c_str(), int(position.x)-width/2, int(position.y), fontSize, color);
-        }
-        else {
-            DrawText(text.c_str(), int(position.x), int(position.y), fontSize, color);
+        if (dirty)
+            layout();
+        Canvas& target = canvas();
+        const float x = static_cast<float>(center ? int(position.x) - width / 2 : int(position.x));
+        const float y = static_cast<float>(int(position.y));
+        for (const auto& glyph : glyphs) {
+            target.glyph(glyph.codepoint, Vector2{ x + glyph.offset.x, y + glyph.offset.y }, drawSize, color);
         }
     }
 
-    std::string text;
     int fontSize;
     Color color;
     bool center;
+
+protected:
+    typedef struct Glyph {
+        int codepoint;
+        Vector2 offset;
+    } Glyph;
+
+    // same walk as DrawTextEx(): every character advances by its width plus the spacing DrawText()
+    // uses for this size; blanks advance without a glyph
+    void layout() {
+        Canvas& target = canvas();
+        const int baseSize = target.fontBaseSize();
+        const int size = std::max(fontSize, int(defaultFontSize));
+        const float spacing = static_cast<float>(size / defaultFontSize);
+        drawSize = static_cast<float>(size);
+        width = target.measureText(text.c_str(), fontSize);
+        glyphs.clear();
+        Vector2 offset{ 0.0f, 0.0f };
+        for (const char ch : text) {
+            if (ch == '\n') {
+                offset.x = 0.0f;
+                offset.y += static_cast<float>(static_cast<int>((baseSize + baseSize / 2) * (drawSize / baseSize)));
+                continue;
+            }
+            if (ch != ' ' && ch != '\t') {
+                glyphs.push_back({ static_cast<unsigned char>(ch), offset });
+            }
+            offset.x += target.glyphWidth(static_cast<unsigned char>(ch), drawSize) + spacing;
+        }
+        dirty = false;
+    }
+
+    static const int defaultFontSize = 10;
+
+    std::string text;
+    bool dirty;
+    int width;
+    float drawSize;
+    std::vector<Glyph> glyphs;
 };
 
 
@@ -95,17 +312,22 @@ public:
     typedef Text super;
     BallCountText(const Vector2& position = { 0 })
         : Text(GRAY, position)
-        , count(0) {}
+        , count(0)
+        , shownCount(-1) {}
 
     virtual void doRender() override
     {
-        std::stringstream ss;
-        ss << "You caught " << count << (count == 1 ? " ball." : " balls.");
-        this->text = ss.str();
+        if (count != shownCount) {
+            TextBuilder builder;
+            builder.append("You caught ").append(count).append(count == 1 ? " ball." : " balls.");
+            setText(builder.c_str());
+            shownCount = count;
+        }
         super::doRender();
     }
 
     int count;
+    int shownCount;
 };
 
 class WildCircle : public Thing
@@ -128,7 +350,7 @@ public:
             return;
         for (int ii = rings.size()-1; ii >= 0; --ii) {
             const float radius = static_cast<float>(startRadius + ii * circleDelta);
-            DrawCircleV(position, radius, rings[ii]);
+            canvas().circle(position, radius, rings[ii]);
         }
     }
 
@@ -144,13 +366,14 @@ public:
 
     void next()
     {
-        std::vector<Color> palette = {
+        static const Color palette[] = {
             {242, 242, 48},
             {194, 242, 97},
             {145, 242, 145},
             {97, 242, 194},
             {48, 242, 242}
         };
+        const size_t paletteSize = sizeof(palette) / sizeof(palette[0]);
         if (!started)
             return;
         if (rings.size() < (size_t)numCircles) {
@@ -160,7 +383,7 @@ public:
             position = Vector2{ (float)GetRandomValue(startRadius, GetScreenWidth() - startRadius),
                                 (float)GetRandomValue(startRadius, GetScreenHeight() - startRadius) };
         }*/
-        Color targetColor = palette[ring % palette.size()];
+        Color targetColor = palette[ring % paletteSize];
         float val = (float)GetRandomValue(600, 1000) / 1000.0f;
         rings[ring] = Color{ static_cast<unsigned char>((float)targetColor.r * val),
                              static_cast<unsigned char>((float)targetColor.g * val),
@@ -214,59 +437,114 @@ void playerCornersInSimSpace(
 
 
 
-bool inGridRange(const GridPosition& pos, const GridPosition& gp1, const GridPosition& gp2)
+// Calls f(slice, position) on the cells of the box between gp1 and gp2 within slices [startSlice,
+// endSlice], positions wrapping around the slice the way LevelGeometry::setGridRange() fills it,
+// until f returns true; returns whether it did.
+template<typename F>
+bool anyInGridRange(const GridPosition& gp1, const GridPosition& gp2, int sliceSize, int startSlice, int endSlice, F f)
 {
-    if (gp1.slice == INT_MIN && gp2.slice == INT_MIN)
-        return false;
-
-    GridPosition minGp(std::min(gp1.slice, gp2.slice), std::min(gp1.positionInSlice, gp2.positionInSlice));
-    GridPosition maxGp(std::max(gp1.slice, gp2.slice), std::max(gp1.positionInSlice, gp2.positionInSlice));
-    return pos.slice >= minGp.slice && pos.slice <= maxGp.slice && pos.positionInSlice >= minGp.positionInSlice && pos.positionInSlice <= maxGp.positionInSlice;
+    const int firstSlice = std::max(std::min(gp1.slice, gp2.slice), startSlice);
+    const int lastSlice = std::min(std::max(gp1.slice, gp2.slice), endSlice);
+    const int firstPosition = std::min(gp1.positionInSlice, gp2.positionInSlice);
+    const int span = std::min(std::max(gp1.positionInSlice, gp2.positionInSlice) - firstPosition, sliceSize - 1);
+    const int start = (firstPosition % sliceSize + sliceSize) % sliceSize;
+    for (int slice = firstSlice; slice <= lastSlice; ++slice) {
+        for (int ii = 0; ii <= span; ++ii) {
+            if (f(slice, start + ii < sliceSize ? start + ii : start + ii - sliceSize))
+                return true;
+        }
+    }
+    return false;
 }
 
+// Whether bb can be reached from aa through empty cells of slices [startSlice, endSlice], treating
+// the box between tempWallA and tempWallB as wall. If path is given and there is a way, it is left
+// with a nonzero flag on every cell of one such way, (slice - startSlice) * sliceSize + position.
 bool havePath(const GridPosition& aa, const GridPosition& bb,
     const std::vector< std::vector< unsigned char > >& geom,
-    int sliceSize, int startSlice, int endSlice, GridPosition tempWallA = { INT_MIN, INT_MIN }, GridPosition tempWallB = { INT_MIN, INT_MIN }) {
+    int sliceSize, int startSlice, int endSlice, GridPosition tempWallA = { INT_MIN, INT_MIN }, GridPosition tempWallB = { INT_MIN, INT_MIN },
+    std::vector<unsigned char>* path = nullptr) {
+    PROFILE_SCOPE("havePath");
     assert(! geom[aa.slice][aa.positionInSlice]);
     assert(! geom[bb.slice][bb.positionInSlice]);
     assert(aa.slice >= startSlice && aa.slice <= endSlice);
     assert(bb.slice >= startSlice && bb.slice <= endSlice);
 
-    std::vector< bool > visited((endSlice - startSlice + 1) * sliceSize, false);
-    std::vector< GridPosition > candidates;
+    // called thousands of times while generating a maze, so the scratch lives in the generation arena
+    Arena& arena = generationArena();
+    ArenaScope scope(arena);
+    const size_t numCells = size_t(endSlice - startSlice + 1) * sliceSize;
+    // 0 if not reached yet, else the way back to the cell it was reached from, or the temporary wall
+    enum : unsigned char { Unvisited, FromSliceBelow, FromSliceAbove, FromPositionBelow, FromPositionAbove, Start, TempWall };
+    ArenaVector< unsigned char > visited(numCells, Unvisited, arena);
+    ArenaVector< GridPosition > candidates(arena);
+    candidates.reserve(numCells); // cells are marked when queued, so each is queued at most once
+    if (tempWallA.slice != INT_MIN || tempWallB.slice != INT_MIN) {
+        anyInGridRange(tempWallA, tempWallB, sliceSize, startSlice, endSlice, [&](int slice, int position) {
+            visited[size_t(slice - startSlice) * sliceSize + position] = TempWall;
+            return false;
+        });
+    }
 
     auto visitedArrayElem = [startSlice, endSlice, sliceSize](const GridPosition& position) -> int {
         assert(position.slice >= startSlice && position.slice <= endSlice);
         return (position.slice - startSlice) * sliceSize + position.positionInSlice;
     };
 
-    auto testAndAdd = [&](const GridPosition& newPos) {
+    auto testAndAdd = [&](const GridPosition& newPos, unsigned char from) {
         if (newPos.slice > endSlice || newPos.slice < startSlice ||
-            visited[visitedArrayElem(newPos)] || geom[newPos.slice][newPos.positionInSlice] ||
-            inGridRange(newPos, tempWallA, tempWallB))
+            visited[visitedArrayElem(newPos)] || geom[newPos.slice][newPos.positionInSlice])
             return;
+        visited[visitedArrayElem(newPos)] = from;
         candidates.push_back(newPos);
     };
 
-    visited[visitedArrayElem(aa)] = true;
+    visited[visitedArrayElem(aa)] = Start;
     candidates.push_back(aa);
     bool pathExists = false;
-    while (!pathExists && !candidates.empty()) {
-        GridPosition pos = candidates.back();
-        candidates.pop_back();
-        visited[visitedArrayElem(pos)] = true;
+    // breadth first, so the way found is a shortest one and few walls cross it
+    for (size_t next = 0; !pathExists && next < candidates.size(); ++next) {
+        const GridPosition pos = candidates[next];
         if (pos == bb) {
             pathExists = true;
             continue;
         }
-        testAndAdd(GridPosition(pos.slice + 1, pos.positionInSlice));
-        testAndAdd(GridPosition(pos.slice - 1, pos.positionInSlice));
-        testAndAdd(GridPosition(pos.slice, (pos.positionInSlice - 1 + sliceSize) % sliceSize));
-        testAndAdd(GridPosition(pos.slice, (pos.positionInSlice + 1) % sliceSize));
+        testAndAdd(GridPosition(pos.slice + 1, pos.positionInSlice), FromSliceBelow);
+        testAndAdd(GridPosition(pos.slice - 1, pos.positionInSlice), FromSliceAbove);
+        testAndAdd(GridPosition(pos.slice, (pos.positionInSlice - 1 + sliceSize) % sliceSize), FromPositionAbove);
+        testAndAdd(GridPosition(pos.slice, (pos.positionInSlice + 1) % sliceSize), FromPositionBelow);
+    }
+    if (pathExists && path) {
+        path->assign(numCells, 0);
+        GridPosition pos = bb;
+        for (;;) {
+            const unsigned char from = visited[visitedArrayElem(pos)];
+            (*path)[visitedArrayElem(pos)] = 1;
+            if (from == Start)
+                break;
+            if (from == FromSliceBelow)
+                --pos.slice;
+            else if (from == FromSliceAbove)
+                ++pos.slice;
+            else if (from == FromPositionBelow)
+                pos.positionInSlice = (pos.positionInSlice - 1 + sliceSize) % sliceSize;
+            else
+                pos.positionInSlice = (pos.positionInSlice + 1) % sliceSize;
+        }
     }
     return pathExists;
 }
 
+// Whether any cell flagged in path, as havePath() leaves it for slices [startSlice, endSlice], is in
+// the box between gp1 and gp2.
+bool pathInGridRange(const std::vector<unsigned char>& path, int sliceSize, int startSlice, int endSlice,
+    const GridPosition& gp1, const GridPosition& gp2)
+{
+    return anyInGridRange(gp1, gp2, sliceSize, startSlice, endSlice, [&](int slice, int position) {
+        return path[size_t(slice - startSlice) * sliceSize + position] != 0;
+    });
+}
+
 
 class SafeImage
 {
@@ -275,12 +553,12 @@ class SafeImage
         SafeImage& operator=(SafeImage const&) = delete;
 
         SafeImage(const char fname[]) {
-            image = LoadImage(fname);
-            colorArr = LoadImageColors(image);
+            image = trackedLoadImage(fname);
+            colorArr = trackedLoadImageColors(image);
         }
         ~SafeImage() {
-            UnloadImageColors(colorArr);
-            UnloadImage(image);
+            trackedUnloadImageColors(colorArr, image);
+            trackedUnloadImage(image);
         }
         Color& color(int x, int y) const { return colorArr[image.width * y + x]; }
         Color* colorArr;
@@ -401,100 +679,347 @@ public:
     Vector2 screenCenter;
 };
 
-class Explosion : public Thing
+// Screen space primitives produced by render preparation. Lists are filled by jobs and submitted to
+// raylib on the main thread, in the order the single threaded path would have drawn them.
+class DrawList
 {
 public:
-    typedef struct SimElement {
-        Vector2 dir;
-        float t1;
-        float t2;
-        float vel1;
-        float vel2;
-        int count;
+    typedef struct Triangle {
+        Vector2 a;
+        Vector2 b;
+        Vector2 c;
+        Color color;
+    } Triangle;
+
+    typedef struct Line {
+        Vector2 a;
+        Vector2 b;
         Color color;
+    } Line;
+
+    void clear() {
+        triangles.clear();
+        lines.clear();
+    }
+
+    void triangle(const Vector2& a, const Vector2& b, const Vector2& c, const Color& color) {
+        triangles.push_back({ a, b, c, color });
+    }
+
+    void line(const Vector2& a, const Vector2& b, const Color& color) {
+        lines.push_back({ a, b, color });
+    }
 
-        SimElement() {
-            vel1 = vel2 = t1 = t2 = 0.0f;
-            dir = Vector2{ 0,0 };
-            count = 0;
-            static std::vector<Color> colors = { {124, 10, 2, 255}, {178, 34, 34, 255}, {226, 88, 34, 255}, {241, 188, 49}, {246, 240, 82} };
-            
-            color = colors[GetRandomValue(0, colors.size() - 1)];
+    void submit() const {
+        PROFILE_COUNT(ProfileCounter::Triangles, static_cast<long long>(triangles.size()));
+        PROFILE_COUNT(ProfileCounter::Lines, static_cast<long long>(lines.size()));
+        Canvas& target = canvas();
+        for (const auto& tri : triangles) {
+            target.triangle(tri.a, tri.b, tri.c, tri.color);
+        }
+        for (const auto& ln : lines) {
+            target.line(ln.a, ln.b, ln.color);
         }
-        void setDir(Vector2 dir) {
-            this->dir = Vector2Normalize(dir);
+    }
+
+    static void submit(const std::vector<DrawList>& lists) {
+        for (const auto& list : lists) {
+            list.submit();
         }
+    }
 
-        void simit() {
-            t1 += vel1;
-            t2 += vel2;
-            ++count;
+    // every numLayers-th list from layer on, for lists filled a few layers at a time
+    static void submit(const std::vector<DrawList>& lists, int numLayers, int layer) {
+        for (size_t ii = layer; ii < lists.size(); ii += numLayers) {
+            lists[ii].submit();
         }
+    }
 
-        void renderit(const Vector2& origin, LevelTransformer& transform) {
-            Vector2 pa = Vector2Add(origin, Vector2Multiply(dir, { t1, t1 }));
-            Vector2 pb = Vector2Add(origin, Vector2Multiply(dir, { t2, t2 }));
+    std::vector<Triangle> triangles;
+    std::vector<Line> lines;
+};
+
+// A particle pool drawn as streaks. Every particle becomes a polyline that starts at its tail and
+// runs length times the tail-head distance, so it bends with the tunnel projection, and fades out
+// with age once it is older than fadeStart.
+//
+// Streaks are only split as finely as their projected curve needs. The projection kinks a streak
+// on tunnel corners and on the slice at the screen center (everything past it lands on one point);
+// those get a vertex of their own and each piece between them gets enough segments to stay within
+// maxErrorPixels, but never more than uniform sampling with maxPoints would have used. All
+// segments of a frame go into one line buffer allocated up front for the worst case. Preparation
+// runs in three steps: count segments per particle, prefix sum into offsets, fill; the first and
+// last run in parallel and the result does not depend on thread count.
+class StreakEffect : public Thing
+{
+public:
+    StreakEffect(int capacity, const Color* palette, int numColors, int maxPoints)
+        : particles(capacity)
+        , palette(palette)
+        , length(1.0f)
+        , maxPoints(maxPoints)
+        , fadeStart(0)
+        , fadePerTick(0)
+        , segmentCount(nullptr)
+        , segmentOffset(nullptr)
+        , pieceSegments(nullptr)
+    {
+        MemoryTagScope tag(MemoryTag::Effects);
+        emitter.numColors = numColors;
+        batch.lines.reserve(size_t(capacity) * (maxPoints + maxKinks));
+    }
+
+    void simit() {
+        particles.update();
+        emitter.tick(particles);
+    }
 
-            Vector2 pas = transform.simToScreen(pa.x, pa.y);
-            Vector2 pbs = transform.simToScreen(pb.x, pb.y);
-            std::vector< Vector2 > pts;
-            const int nExplosionPoints = 50;
-            for (int ii = 0; ii < nExplosionPoints; ++ii) {
-                float tt = float(ii) / 9;
-                Vector2 ptSim = Vector2Lerp(pa, pb, tt);
-                pts.push_back(transform.simToScreen(ptSim.x, ptSim.y));
+    // Where the projection of the sim space segment p0-p1 kinks, as fractions of its length in
+    // increasing order; returns how many (at most maxKinks).
+    int kinks(const Vector2& p0, const Vector2& p1, float* ts) const {
+        int numKinks = 0;
+        auto add = [&](float tt) {
+            int jj = numKinks++;
+            for (; jj > 0 && ts[jj - 1] > tt; --jj) {
+                ts[jj] = ts[jj - 1];
             }
-            unsigned char aa = 255;
-            if (count*2 > 50) {
-                aa = std::max(0, 255 + 50 - count*2);
+            ts[jj] = tt;
+        };
+
+        const float center = transform.sliceAtCenter;
+        if ((p0.x < center) != (p1.x < center)) {
+            add((center - p0.x) / (p1.x - p0.x));
+        }
+
+        const float lo = std::min(p0.y, p1.y);
+        const float hi = std::max(p0.y, p1.y);
+        const float size = static_cast<float>(transform.sliceSize);
+        const float corners[4] = { 0.0f, transform.fSliceWidth, transform.fSliceWidth + transform.fSliceHeight,
+            2.0f * transform.fSliceWidth + transform.fSliceHeight };
+        for (float base = floorf(lo / size) * size; base < hi && numKinks < maxKinks; base += size) {
+            for (int cc = 0; cc < 4 && numKinks < maxKinks; ++cc) {
+                const float corner = base + corners[cc];
+                if (corner > lo && corner < hi) {
+                    add((corner - p0.y) / (p1.y - p0.y));
+                }
             }
-            color.a = aa;
-            for (int ii = 0; ii < nExplosionPoints-1; ++ii) {
-                DrawLineV(pts[ii], pts[ii+1], color);
+        }
+        return numKinks;
+    }
+
+    // Splits particle ii into pieces at its kinks and picks a segment count for every piece; between
+    // kinks the projection bends a streak roughly like a quadratic, whose midpoint error drops with
+    // the square of the segment count. Returns the total.
+    int countSegments(int ii) {
+        const Vector2 pa{ particles.tailX[ii], particles.tailY[ii] };
+        const Vector2 pe = Vector2Lerp(pa, Vector2{ particles.headX[ii], particles.headY[ii] }, length);
+        float ts[maxKinks + 2];
+        const int numPieces = kinks(pa, pe, ts + 1) + 1;
+        ts[0] = 0.0f;
+        ts[numPieces] = 1.0f;
+
+        unsigned char* pieces = &pieceSegments[size_t(ii) * (maxKinks + 1)];
+        int total = 0;
+        Vector2 s0 = transform.simToScreen(pa.x, pa.y);
+        for (int pp = 0; pp < numPieces; ++pp) {
+            const Vector2 pm = Vector2Lerp(pa, pe, 0.5f * (ts[pp] + ts[pp + 1]));
+            const Vector2 p1 = Vector2Lerp(pa, pe, ts[pp + 1]);
+            const Vector2 sm = transform.simToScreen(pm.x, pm.y);
+            const Vector2 s1 = transform.simToScreen(p1.x, p1.y);
+            const float bend = Vector2Distance(sm, Vector2Lerp(s0, s1, 0.5f));
+            const int uniform = static_cast<int>(ceilf(float(maxPoints - 1) * (ts[pp + 1] - ts[pp])));
+            const int segments = std::max(1, std::min(uniform, static_cast<int>(ceilf(sqrtf(bend / maxErrorPixels)))));
+            pieces[pp] = static_cast<unsigned char>(segments);
+            total += segments;
+            s0 = s1;
+        }
+        return total;
+    }
+
+    void renderit(int ii, DrawList::Line* lines) const {
+        const Vector2 pa{ particles.tailX[ii], particles.tailY[ii] };
+        const Vector2 pe = Vector2Lerp(pa, Vector2{ particles.headX[ii], particles.headY[ii] }, length);
+        const int age = particles.age[ii];
+        Color color = palette[particles.colorIndex[ii]];
+        color.a = static_cast<unsigned char>(std::max(0, std::min(255, 255 - (age - fadeStart) * fadePerTick)));
+
+        float ts[maxKinks + 2];
+        const int numPieces = kinks(pa, pe, ts + 1) + 1;
+        ts[0] = 0.0f;
+        ts[numPieces] = 1.0f;
+
+        const unsigned char* pieces = &pieceSegments[size_t(ii) * (maxKinks + 1)];
+        Vector2 prev = transform.simToScreen(pa.x, pa.y);
+        int line = 0;
+        for (int pp = 0; pp < numPieces; ++pp) {
+            const int segments = pieces[pp];
+            for (int jj = 1; jj <= segments; ++jj) {
+                const float tt = ts[pp] + (ts[pp + 1] - ts[pp]) * float(jj) / float(segments);
+                const Vector2 ptSim = Vector2Lerp(pa, pe, tt);
+                const Vector2 pt = transform.simToScreen(ptSim.x, ptSim.y);
+                lines[line++] = { prev, pt, color };
+                prev = pt;
             }
         }
-    } SimElement;
+    }
+
+    void doRender() override {
+        PROFILE_SCOPE("StreakEffect::doRender");
+        prepare();
+        batch.submit();
+    }
+
+    // everything doRender() does before the lines go to raylib
+    void prepare() {
+        const int numParticles = particles.size();
+        Arena& arena = frameArena();
+        segmentCount = arena.allocateArray<int>(numParticles);
+        segmentOffset = arena.allocateArray<int>(numParticles);
+        pieceSegments = arena.allocateArray<unsigned char>(size_t(numParticles) * (maxKinks + 1));
+        jobSystem().parallelFor(numParticles, particlesPerJob, [&](int begin, int end) {
+            for (int ii = begin; ii < end; ++ii) {
+                segmentCount[ii] = countSegments(ii);
+            }
+        });
+        int numLines = 0;
+        for (int ii = 0; ii < numParticles; ++ii) {
+            segmentOffset[ii] = numLines;
+            numLines += segmentCount[ii];
+        }
+        batch.lines.resize(numLines); // never past the reserved worst case
+        jobSystem().parallelFor(numParticles, particlesPerJob, [&](int begin, int end) {
+            for (int ii = begin; ii < end; ++ii) {
+                renderit(ii, &batch.lines[segmentOffset[ii]]);
+            }
+        });
+    }
+
+    const DrawList& prepared() const { return batch; }
+
+    static const int particlesPerJob = 64;
+    static const int maxKinks = 5; // four corners plus the center slice
+    static constexpr float maxErrorPixels = 0.5f; // allowed gap between polyline and curve
+
+    ParticlePool particles;
+    ParticleEmitter emitter;
+    const Color* palette;
+    float length;
+    int maxPoints;
+    int fadeStart;
+    int fadePerTick;
+    LevelTransformer transform;
+
+private:
+    // per frame scratch from the frame arena
+    int* segmentCount;
+    int* segmentOffset;
+    unsigned char* pieceSegments; // maxKinks + 1 per particle
+    DrawList batch;
+};
 
+class Explosion : public StreakEffect
+{
+public:
     Explosion()
+        : StreakEffect(maxShards, colors, numColors, 50)
     {
-        const int numShards = 100;
-        for (int ii = 0; ii < numShards; ++ii) {
-            add();
-        }
+        emitter.rate = 30;
+        emitter.budget = maxShards;
+        emitter.minSpeed = 0.0f;
+        emitter.maxSpeed = 1.3f;
+        emitter.minTailFactor = 0.8f;
+        emitter.maxTailFactor = 1.0f;
+        emitter.lifetime = 153; // fully faded out by then
+        length = 49.0f / 9.0f;
+        fadeStart = 25;
+        fadePerTick = 2;
     }
 
-    void add() {
-        float deg = RandFloat(360.0f);
-        Vector2 dir = Vector2Rotate({ 1.0f, 0.0f }, deg);
-        SimElement elem;
-        elem.setDir(dir);
-        elem.vel2 = RandFloat(1.3f);
-        elem.vel1 = elem.vel2 * (0.8f + RandFloat(0.2f));
-        explosionShards.push_back(elem);
+    void start(const SimSpacePosition& position) {
+        origin = position;
+        emitter.originX = origin.slice;
+        emitter.originY = origin.positionInSlice;
+        emitter.restart();
+        particles.clear();
+        emitter.burst(particles, 100);
     }
+
     void simit(int simTick) {
-        for (auto& elem : explosionShards) {
-            elem.simit();
-        }
-        if (explosionShards.size() < 1000)
-            for (int pp = 0; pp < 30; ++pp) add();
+        PROFILE_SCOPE("Explosion::simit");
+        StreakEffect::simit();
     }
 
-    void doRender() override {
-        Vector2 originV{ origin.slice, origin.positionInSlice };
-        for (auto& elem : explosionShards) {
-            elem.renderit(originV, transform);
-        }
-    }
+    static const int maxShards = 1000;
+    static const int numColors = 5;
+    static const Color colors[numColors];
 
-    LevelTransformer transform;
     SimSpacePosition origin;
-    std::vector< SimElement > explosionShards;
 };
 
+const Color Explosion::colors[Explosion::numColors] = { {124, 10, 2, 255}, {178, 34, 34, 255}, {226, 88, 34, 255}, {241, 188, 49, 255}, {246, 240, 82, 255} };
+
+// Sparks thrown off the player when it scrapes a wall
+class Sparks : public StreakEffect
+{
+public:
+    Sparks()
+        : StreakEffect(4096, colors, numColors, 3)
+        , lastBurstTick(INT_MIN / 2)
+    {
+        emitter.rate = 0; // bursts only
+        emitter.minSpeed = 0.1f;
+        emitter.maxSpeed = 0.6f;
+        emitter.minTailFactor = 0.3f;
+        emitter.maxTailFactor = 0.7f;
+        emitter.lifetime = 20;
+        length = 1.0f;
+        fadeStart = 0;
+        fadePerTick = 13;
+    }
+
+    // attach to the player and throw a handful of sparks, at most once every few ticks
+    void scrape(const SimSpacePosition& position, int simTick) {
+        if (simTick - lastBurstTick < 4)
+            return;
+        lastBurstTick = simTick;
+        emitter.originX = position.slice;
+        emitter.originY = position.positionInSlice;
+        burst();
+    }
+
+    // the spawning half of scrape(), at the current origin
+    void burst() {
+        emitter.burst(particles, sparksPerScrape);
+    }
+
+    static const int sparksPerScrape = 12;
+
+    static const int numColors = 3;
+    static const Color colors[numColors];
+
+    int lastBurstTick;
+};
+
+const Color Sparks::colors[Sparks::numColors] = { {255, 255, 255, 255}, {253, 249, 120, 255}, {255, 180, 60, 255} };
+
+// When the walls of a phase group are there: for solidTicks ticks out of every period, starting
+// offset ticks into it.
+typedef struct PhaseSchedule {
+    PhaseSchedule(int period = 1, int solidTicks = 1, int offset = 0)
+        : period(period)
+        , solidTicks(solidTicks)
+        , offset(offset) {}
+    bool solidAt(int tick) const { return ((tick + offset) % period + period) % period < solidTicks; }
+    int period;
+    int solidTicks;
+    int offset;
+} PhaseSchedule;
+
 class LevelGeometry : public Thing
 {
 public:
+    // A placeholder grid with nothing built from it: every game generates, loads or copies its level
+    // straight away, and those index it. Collision, edits and drawing wait for one of them.
     LevelGeometry()
         : Thing()
         , playerPosition(static_cast<float>(sliceWidth / 2))
@@ -504,6 +1029,8 @@ public:
         , dangerZone(startingDangerZone)
         , transformer(sliceSize, sliceWidth, sliceHeight, worldWidth, worldHeight)
     {
+        MemoryTagScope tag(MemoryTag::Level);
+        Grid& geom = changeShape().geom;
         geom.resize(numSlices);
         for (int ii = 0; ii < numSlices; ++ii) {
             geom[ii].resize(sliceSize);
@@ -518,13 +1045,140 @@ public:
                 geom[ii][jj] = sliceVal;
             }
         }
-        updateWorldGeom();
     }
 
     virtual void doRender() override;
 
+    // the lookups built from geom, after it changes
+    void indexGeometry() {
+        MemoryTagScope tag(MemoryTag::Level);
+        LevelShape& level = changeShape();
+        const Grid& geom = level.geom;
+        level.clearance.build(geom);
+        level.walls.build(geom, solidCell);
+        phaseGroups = 0;
+        for (const auto& slice : geom) {
+            for (unsigned char cell : slice) {
+                if (cell != 0 && cell != solidCell) {
+                    assert(cell <= maxPhaseGroups);
+                    phaseGroups |= phaseBit(cell);
+                }
+            }
+        }
+        for (int group = 1; group <= maxPhaseGroups; ++group) {
+            if (phaseGroups & phaseBit(group))
+                level.phaseWalls[group - 1].build(geom, group);
+            else
+                level.phaseWalls[group - 1] = CollisionMask();
+        }
+        ++geometryVersion;
+        // a new level: nothing to catch up with or undo
+        dirtyChunks.assign((geom.size() + editChunkSlices - 1) / editChunkSlices, 0);
+        newPhaseGroups = 0;
+        editLog.clear();
+        editSteps.clear();
+    }
+
+    // Level edits. Once a level is built, writes to geom go through setCell() or fillCells(), which
+    // mark the chunks of editChunkSlices slices they touch and log what each cell was. applyEdits()
+    // brings the lookups up to date chunk by chunk and must come before the next collision test;
+    // endEdit() closes an undo step and undoEdit() takes the last one back. World vertices only
+    // depend on the number of slices, which edits leave alone. A value that is not a cell (see
+    // validCell()) is refused: nothing is written and false comes back.
+    bool setCell(int slice, int position, unsigned char value) {
+        if (!validCell(value))
+            return false;
+        if (slice < 0 || slice >= static_cast<int>(shape->geom.size()))
+            return true;
+        position = (position % sliceSize + sliceSize) % sliceSize;
+        const unsigned char cell = shape->geom[slice][position];
+        if (cell == value)
+            return true;
+        editLog.push_back(CellEdit{ slice, static_cast<unsigned short>(position), cell });
+        writeCell(slice, position, value);
+        return true;
+    }
+
+    // every cell in the box between gp1 and gp2, positions wrapping as setGridRange() does
+    bool fillCells(const GridPosition& gp1, const GridPosition& gp2, unsigned char value) {
+        if (!validCell(value))
+            return false;
+        const int firstSlice = std::max(0, std::min(gp1.slice, gp2.slice));
+        const int lastSlice = std::min(static_cast<int>(shape->geom.size()) - 1, std::max(gp1.slice, gp2.slice));
+        const int firstPosition = std::min(gp1.positionInSlice, gp2.positionInSlice);
+        const int lastPosition = std::min(std::max(gp1.positionInSlice, gp2.positionInSlice), firstPosition + sliceSize - 1);
+        for (int slice = firstSlice; slice <= lastSlice; ++slice) {
+            for (int position = firstPosition; position <= lastPosition; ++position) {
+                setCell(slice, position, value);
+            }
+        }
+        return true;
+    }
+
+    void endEdit() {
+        if (editLog.size() > (editSteps.empty() ? 0 : editSteps.back()))
+            editSteps.push_back(editLog.size());
+    }
+
+    // puts back the cells of the last undo step, if there is one; applyEdits() still has to follow
+    bool undoEdit() {
+        endEdit();
+        if (editSteps.empty())
+            return false;
+        editSteps.pop_back();
+        const size_t start = editSteps.empty() ? 0 : editSteps.back();
+        while (editLog.size() > start) {
+            const CellEdit& edit = editLog.back();
+            writeCell(edit.slice, edit.position, edit.before);
+            editLog.pop_back();
+        }
+        return true;
+    }
+
+    void applyEdits() {
+        PROFILE_SCOPE("applyEdits");
+        MemoryTagScope tag(MemoryTag::Level);
+        if (!editsPending())
+            return;
+        LevelShape& level = changeShape();
+        const Grid& geom = level.geom;
+        const int numChunks = static_cast<int>(dirtyChunks.size());
+        for (int chunk = 0; chunk < numChunks;) {
+            if (!dirtyChunks[chunk]) {
+                ++chunk;
+                continue;
+            }
+            // runs of dirty chunks at a time
+            int end = chunk;
+            while (end < numChunks && dirtyChunks[end]) {
+                dirtyChunks[end++] = 0;
+            }
+            const int firstSlice = chunk * editChunkSlices;
+            const int lastSlice = std::min(end * editChunkSlices, static_cast<int>(geom.size())) - 1;
+            level.clearance.update(geom, firstSlice, lastSlice);
+            level.walls.update(geom, firstSlice, lastSlice);
+            for (int group = 1; group <= maxPhaseGroups; ++group) {
+                if (phaseGroups & phaseBit(group))
+                    level.phaseWalls[group - 1].update(geom, firstSlice, lastSlice);
+            }
+            chunk = end;
+            ++geometryVersion;
+        }
+        for (int group = 1; group <= maxPhaseGroups; ++group) {
+            if (newPhaseGroups & phaseBit(group))
+                level.phaseWalls[group - 1].build(geom, group);
+        }
+        phaseGroups |= newPhaseGroups;
+        newPhaseGroups = 0;
+    }
+
+    bool editsPending() const { return newPhaseGroups != 0 || std::find(dirtyChunks.begin(), dirtyChunks.end(), 1) != dirtyChunks.end(); }
+
     void updateWorldGeom() {
-        worldGeom.resize(geom.size() + 1);
+        MemoryTagScope tag(MemoryTag::Level);
+        LevelShape& level = changeShape();
+        std::vector< std::vector<Vector3> >& worldGeom = level.worldGeom;
+        worldGeom.resize(level.geom.size() + 1);
         for (size_t ii = 0; ii < worldGeom.size(); ++ii) {
             std::vector<Vector3>& worldSlice = worldGeom[ii];
             worldSlice.resize(sliceSize + 1);
@@ -533,12 +1187,32 @@ public:
             }
         }
     }
+    // The level of another, edits it has yet to apply included, without its undo steps, the player or
+    // danger zone. The two share one shape until either changes it.
+    void copyLevel(const LevelGeometry& source) {
+        MemoryTagScope tag(MemoryTag::Level);
+        numSlices = source.numSlices;
+        shape = source.shape;
+        for (int group = 0; group < maxPhaseGroups; ++group) {
+            phaseSchedules[group] = source.phaseSchedules[group];
+        }
+        phaseGroups = source.phaseGroups;
+        dirtyChunks = source.dirtyChunks;
+        newPhaseGroups = source.newPhaseGroups;
+        ++geometryVersion;
+        editLog.clear();
+        editSteps.clear();
+        winningZone = source.winningZone;
+    }
+
     void loadLevelFromImage(const char fname[]) {
-        Image levelImage = LoadImage(fname);
-        Color* colors = LoadImageColors(levelImage);
+        MemoryTagScope tag(MemoryTag::Level);
+        Image levelImage = trackedLoadImage(fname);
+        Color* colors = trackedLoadImageColors(levelImage);
         numSlices = levelImage.width;
         int height = std::max(levelImage.height, sliceSize);
 
+        Grid& geom = changeShape().geom;
         geom.resize(numSlices);
         for (int ii = 0; ii < numSlices; ++ii) {
             geom[ii].resize(sliceSize);
@@ -552,10 +1226,11 @@ public:
                 geom[ii][jj] = val;
             }
         }
-        winningZone = int(geom.size()) - 100;
+        winningZone = numSlices - 100;
+        indexGeometry();
         updateWorldGeom();
-        UnloadImageColors(colors);
-        UnloadImage(levelImage);
+        trackedUnloadImageColors(colors, levelImage);
+        trackedUnloadImage(levelImage);
     }
 
 
@@ -580,6 +1255,7 @@ public:
     }
 
     void generateMaze(std::vector< std::vector< unsigned char > >& geom, int startSlice, int endSlice, int sliceRange, int posRange, int width) {
+        PROFILE_SCOPE("generateMaze");
         assert(havePath(GridPosition(startSlice - 1, 0), GridPosition(endSlice + 1, 0), geom, sliceSize, startSlice - 1, endSlice + 1));
         for (int ii = startSlice; ii <= endSlice; ++ii) {
             for (int jj = 0; jj < sliceSize; ++jj) {
@@ -590,16 +1266,17 @@ public:
 
         const int quantize = 2 * width + 3;
         while (!havePath(GridPosition(startSlice - 1, 0), GridPosition(endSlice + 1, 0), geom, sliceSize, startSlice - 1, endSlice + 1)) {
-            GridPosition gp(GetRandomValue(startSlice, endSlice), GetRandomValue(0, sliceSize - 1));
-            if (GetRandomValue(0, 10)) {
-                int randVal = GetRandomValue(2, posRange);
+            const int gpSlice = random.rangeInt(startSlice, endSlice);
+            GridPosition gp(gpSlice, random.rangeInt(0, sliceSize - 1));
+            if (random.rangeInt(0, 10)) {
+                int randVal = random.rangeInt(2, posRange);
                 int secondPos = gp.positionInSlice + randVal;
                 setGridRange(
                     geom, startSlice, endSlice, GridPosition(gp.slice - width, gp.positionInSlice),
                     GridPosition(gp.slice + width, secondPos), 0, 1);
             }
             else {
-                int secondSlice = std::min(gp.positionInSlice + GetRandomValue(1, sliceRange), endSlice);
+                int secondSlice = std::min(gp.positionInSlice + random.rangeInt(1, sliceRange), endSlice);
                 setGridRange(
                     geom, startSlice, endSlice, GridPosition(gp.slice, gp.positionInSlice - width),
                     GridPosition(secondSlice, gp.positionInSlice + width), 0, 1);
@@ -608,13 +1285,23 @@ public:
     }
 
     void generateMaze2(std::vector< std::vector< unsigned char > >& geom, int startSlice, int endSlice, int maxNumLines = 50, int quantizeSlice = 3, int quantizePos = 10) {
+        PROFILE_SCOPE("generateMaze2");
+        clearMaze2(geom, startSlice, endSlice);
+        addMaze2Lines(geom, startSlice, endSlice, maxNumLines, quantizeSlice, quantizePos);
+    }
+
+    void clearMaze2(std::vector< std::vector< unsigned char > >& geom, int startSlice, int endSlice) {
         assert(havePath(GridPosition(startSlice - 1, 0), GridPosition(endSlice + 1, 0), geom, sliceSize, startSlice - 1, endSlice + 1));
+        maze2Path.clear();
         for (int ii = startSlice; ii <= endSlice; ++ii) {
             for (int jj = 0; jj < sliceSize; ++jj) {
                 geom[ii][jj] = 0;
             }
         }
+    }
 
+    // tries numLines walls, keeping those that leave a way through; a maze can be built a few at a time
+    void addMaze2Lines(std::vector< std::vector< unsigned char > >& geom, int startSlice, int endSlice, int numLines, int quantizeSlice, int quantizePos) {
         int nLines = 0;
         const int pQ = quantizePos;
         const int sQ = quantizeSlice;
@@ -623,25 +1310,27 @@ public:
         GridPosition startPos(startSlice - 1, 0);
         GridPosition endPos(endSlice + 1, 0);
 
-        while (nLines < maxNumLines) {
+        while (nLines < numLines) {
             ++nLines;
             GridPosition newWallP0;
             GridPosition newWallP1;
-            if (GetRandomValue(0, sliceSize + 150) < sliceSize) {
-                int pos1 = (GetRandomValue(0, sliceSize) / pQ) * pQ;
-                int pos2 = pos1 + (GetRandomValue(quantizePos * 3, sliceSize/8) / pQ) * pQ;
-                int slice = (GetRandomValue(startSlice, endSlice) / sQ) * sQ;
+            if (random.rangeInt(0, sliceSize + 150) < sliceSize) {
+                int pos1 = (random.rangeInt(0, sliceSize) / pQ) * pQ;
+                int pos2 = pos1 + (random.rangeInt(quantizePos * 3, sliceSize/8) / pQ) * pQ;
+                int slice = (random.rangeInt(startSlice, endSlice) / sQ) * sQ;
                 newWallP0 = GridPosition(slice - sW, pos1);
                 newWallP1 = GridPosition(slice + sW, pos2);
             }
             else {
-                int slice1 = (GetRandomValue(startSlice, endSlice) / sQ) * sQ;
-                int slice2 = slice1 + (GetRandomValue(1, 20) / sQ) * sQ;
-                int pos = (GetRandomValue(0, sliceSize) / pQ) * pQ;
+                int slice1 = (random.rangeInt(startSlice, endSlice) / sQ) * sQ;
+                int slice2 = slice1 + (random.rangeInt(1, 20) / sQ) * sQ;
+                int pos = (random.rangeInt(0, sliceSize) / pQ) * pQ;
                 newWallP0 = GridPosition(slice1, pos - pW);
                 newWallP1 = GridPosition(slice2, pos + pW);
             }
-            if (havePath(startPos, endPos, geom, sliceSize, startSlice - 1, endSlice + 1, newWallP0, newWallP1)) {
+            // a wall clear of the last way through cannot block it, which spares most of the searches
+            const bool clearOfPath = !maze2Path.empty() && !pathInGridRange(maze2Path, sliceSize, startSlice - 1, endSlice + 1, newWallP0, newWallP1);
+            if (clearOfPath || havePath(startPos, endPos, geom, sliceSize, startSlice - 1, endSlice + 1, newWallP0, newWallP1, &maze2Path)) {
                 setGridRange(geom, startSlice, endSlice, newWallP0, newWallP1, 255);
                 assert(havePath(startPos, endPos, geom, sliceSize, startSlice - 1, endSlice + 1));
             }
@@ -649,7 +1338,8 @@ public:
         }
     }
 
-    void generateSlip(std::vector< std::vector< unsigned char > >& geom, int startSlice, int endSlice, const std::vector<int>& positions, int slipWidth, bool fill = true) {
+    void generateSlip(std::vector< std::vector< unsigned char > >& geom, int startSlice, int endSlice, const ArenaVector<int>& positions, int slipWidth, bool fill = true) {
+        PROFILE_SCOPE("generateSlip");
         if (fill) {
             for (int ii = startSlice; ii <= endSlice; ++ii) {
                 for (int jj = 0; jj < sliceSize; ++jj) {
@@ -672,6 +1362,7 @@ public:
     }
 
     void generateRandoWithSlip(std::vector< std::vector< unsigned char > >& geom, int startSlice, int endSlice, int nPoints, int nSlips, int slipWidth) {
+        PROFILE_SCOPE("generateRandoWithSlip");
         for (int ii = startSlice; ii < endSlice; ++ii) {
             for (int jj = 0; jj < sliceSize; ++jj) {
                 geom[ii][jj] = 0;
@@ -679,25 +1370,66 @@ public:
         }
 
         for (int ii = 0; ii < nPoints; ++ii) {
-            geom[GetRandomValue(startSlice, endSlice)][GetRandomValue(0, sliceSize - 1)] = 255;
+            const int slice = random.rangeInt(startSlice, endSlice);
+            geom[slice][random.rangeInt(0, sliceSize - 1)] = 255;
         }
 
-        std::vector<int> randomSlipSpots;
+        ArenaScope scope(generationArena());
+        ArenaVector<int> randomSlipSpots(generationArena());
         for (int ii = 0; ii < nSlips; ++ii) {
-            randomSlipSpots.push_back(GetRandomValue(0, sliceSize - 1));
+            randomSlipSpots.push_back(random.rangeInt(0, sliceSize - 1));
         }
         generateSlip(geom, startSlice, endSlice, randomSlipSpots, slipWidth, false);
     }
 
-    void generateLevel() {
-        numSlices = 2000;
-        geom.resize(numSlices);
-        for (int ii = 0; ii < numSlices; ++ii) {
-            geom[ii].resize(sliceSize);
-            for (int jj = 0; jj < sliceSize; ++jj) {
-                geom[ii][jj] = 0;
+    // A level is generated as a list of steps that must run in order, none of them long, so that the
+    // window can spread one over several frames and keep drawing; generate() runs them all at once.
+    typedef std::function<void()> GenerationStep;
+
+    // a maze's walls are tried against a search of the whole maze, so its steps go by area
+    static const int maze2CellsPerStep = 1 << 17;
+    static const int phaseGateLevel = 3; // see planPhaseGateLevel()
+
+    static void runGeneration(const std::vector<GenerationStep>& steps) {
+        for (const auto& step : steps) {
+            step();
+        }
+    }
+
+    void planEmptyLevel(std::vector<GenerationStep>& steps, int length) {
+        steps.push_back([this, length] {
+            MemoryTagScope tag(MemoryTag::Level);
+            numSlices = length;
+            Grid& geom = changeShape().geom;
+            geom.resize(numSlices);
+            for (int ii = 0; ii < numSlices; ++ii) {
+                geom[ii].resize(sliceSize);
+                for (int jj = 0; jj < sliceSize; ++jj) {
+                    geom[ii][jj] = 0;
+                }
             }
+        });
+    }
+
+    void planMaze2(std::vector<GenerationStep>& steps, int startSlice, int endSlice, int maxNumLines, int quantizeSlice, int quantizePos) {
+        steps.push_back([=] { clearMaze2(changeShape().geom, startSlice, endSlice); });
+        const int linesPerStep = std::max(1, maze2CellsPerStep / ((endSlice - startSlice + 1) * sliceSize));
+        for (int line = 0; line < maxNumLines; line += linesPerStep) {
+            const int numLines = std::min(linesPerStep, maxNumLines - line);
+            steps.push_back([=] { addMaze2Lines(changeShape().geom, startSlice, endSlice, numLines, quantizeSlice, quantizePos); });
         }
+    }
+
+    void planLevelEnd(std::vector<GenerationStep>& steps, int goal) {
+        steps.push_back([this, goal] {
+            winningZone = goal;
+            indexGeometry();
+        });
+        steps.push_back([this] { updateWorldGeom(); });
+    }
+
+    void planLevel(std::vector<GenerationStep>& steps) {
+        planEmptyLevel(steps, 2000);
 
         auto everyN = [](int n, int sliceSize) -> std::vector<int> {
             std::vector<int> result;
@@ -706,38 +1438,44 @@ public:
             }
             return result;
         };
-        std::vector< int > centerPositions{ sliceWidth / 2, sliceWidth + sliceHeight / 2, sliceWidth / 2 + sliceWidth + sliceHeight, sliceWidth * 2 + sliceHeight + sliceHeight / 2 };
-        std::vector< int > cornerPositions{ 0, sliceWidth, sliceWidth + sliceHeight, 2 * sliceWidth + sliceHeight };
+        const std::vector< int > centerPositions({ sliceWidth / 2, sliceWidth + sliceHeight / 2, sliceWidth / 2 + sliceWidth + sliceHeight, sliceWidth * 2 + sliceHeight + sliceHeight / 2 });
+        const std::vector< int > cornerPositions({ 0, sliceWidth, sliceWidth + sliceHeight, 2 * sliceWidth + sliceHeight });
+        auto slip = [this, &steps](int slice, const std::vector<int>& positions, int slipWidth) {
+            steps.push_back([this, slice, positions, slipWidth] {
+                ArenaScope scope(generationArena());
+                generateSlip(changeShape().geom, slice, slice, ArenaVector<int>(positions.begin(), positions.end(), generationArena()), slipWidth);
+            });
+        };
         int currSlice = 50;
 
         for (int ii = 0; ii < 5; ++ii) {
-            generateSlip(geom, currSlice, currSlice, centerPositions, 40);
+            slip(currSlice, centerPositions, 40);
             currSlice += 4;
         }
         for (int ii = 0; ii < 5; ++ii) {
-            generateSlip(geom, currSlice, currSlice, everyN(30, sliceSize), 10);
+            slip(currSlice, everyN(30, sliceSize), 10);
             currSlice += 4;
         }
         currSlice += 10;
         for (int ii = 0; ii < 5; ++ii) {
-            generateSlip(geom, currSlice, currSlice, centerPositions, 45);
+            slip(currSlice, centerPositions, 45);
             currSlice += 4;
-            generateSlip(geom, currSlice, currSlice, cornerPositions, 60);
+            slip(currSlice, cornerPositions, 60);
             currSlice += 4;
         }
 
         currSlice += 10;
         for (int ii = 0; ii < 20; ++ii) {
-            generateSlip(geom, currSlice, currSlice, everyN(50 + ii / 2, sliceSize + ii), 10);
+            slip(currSlice, everyN(50 + ii / 2, sliceSize + ii), 10);
             currSlice += 4;
         }
 
         for (int ii = 0; ii < 5; ++ii) {
-            generateRandoWithSlip(geom, currSlice, currSlice + 10, 50, 3, 15);
+            steps.push_back([this, currSlice] { generateRandoWithSlip(changeShape().geom, currSlice, currSlice + 10, 50, 3, 15); });
             currSlice += 30;
         }
         currSlice += 20;
-        generateRandoWithSlip(geom, currSlice, currSlice + 100, 100, 3, 15);
+        steps.push_back([this, currSlice] { generateRandoWithSlip(changeShape().geom, currSlice, currSlice + 100, 100, 3, 15); });
         currSlice += 130;
 
         //        void generateMaze2(std::vector< std::vector< unsigned char > >&geom, int startSlice, int endSlice, int maxNumLines = 50, int quantizeSlice = 3, int quantizePos = 10) {
@@ -747,124 +1485,293 @@ public:
         //        generateMaze2(geom, currSlice, currSlice + 150, 2000);
         //        currSlice += 170;
 
-        generateMaze2(geom, currSlice, currSlice + 150, 200, 10, 20);
+        planMaze2(steps, currSlice, currSlice + 150, 200, 10, 20);
         currSlice += 170;
 
-        generateMaze2(geom, currSlice, currSlice + 50, 120, 5, 20);
+        planMaze2(steps, currSlice, currSlice + 50, 120, 5, 20);
         currSlice += 60;
-        generateMaze2(geom, currSlice, currSlice + 50, 120, 5, 20);
+        planMaze2(steps, currSlice, currSlice + 50, 120, 5, 20);
         currSlice += 60;
-        generateMaze2(geom, currSlice, currSlice + 50, 120, 5, 20);
+        planMaze2(steps, currSlice, currSlice + 50, 120, 5, 20);
         currSlice += 60;
-        generateMaze2(geom, currSlice, currSlice + 50, 120, 5, 20);
+        planMaze2(steps, currSlice, currSlice + 50, 120, 5, 20);
         currSlice += 60;
 
         currSlice += 40;
-        winningZone = currSlice;
-        updateWorldGeom();
+        planLevelEnd(steps, currSlice);
     }
 
-    void generateLevel2() {
-        numSlices = 2000;
-        geom.resize(numSlices);
-        for (int ii = 0; ii < numSlices; ++ii) {
-            geom[ii].resize(sliceSize);
-            for (int jj = 0; jj < sliceSize; ++jj) {
-                geom[ii][jj] = 0;
-            }
-        }
+    void planLevel2(std::vector<GenerationStep>& steps) {
+        planEmptyLevel(steps, 2000);
 
         int currSlice = 50;
 
         for (int ii = 0; ii < 10; ++ii) {
-            generateMaze2(geom, currSlice, currSlice + 50, 60, 5, 20);
+            planMaze2(steps, currSlice, currSlice + 50, 60, 5, 20);
             currSlice += 60;
         }
 
         currSlice += 40;
-        winningZone = currSlice;
-        updateWorldGeom();
+        planLevelEnd(steps, currSlice);
     }
 
-    void generateLevel3() {
-        numSlices = 2000;
-        geom.resize(numSlices);
-        for (int ii = 0; ii < numSlices; ++ii) {
-            geom[ii].resize(sliceSize);
-            for (int jj = 0; jj < sliceSize; ++jj) {
-                geom[ii][jj] = 0;
-            }
-        }
+    void planLevel3(std::vector<GenerationStep>& steps) {
+        planEmptyLevel(steps, 2000);
 
         int currSlice = 50;
 
-        generateMaze2(geom, currSlice, currSlice + 500, 800, 8, 20);
+        planMaze2(steps, currSlice, currSlice + 500, 800, 8, 20);
         currSlice += 520;
 
         currSlice += 40;
-        winningZone = currSlice;
-        updateWorldGeom();
+        planLevelEnd(steps, currSlice);
     }
 
-    bool collides(float testPlayerSlice, float testPlayerPosition) {
-        auto testSinglePoint = [=](const SimSpacePosition& spp) -> bool {
-            //return false; //TODO: COMMENT THIS LINE!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-            int intSlice = static_cast<int>(floorf(spp.slice));
-            int intSlicePosition = static_cast<int>(floorf(spp.positionInSlice));
-            if (intSlice >= 0 && intSlice < static_cast<int>(geom.size())) {
-                const auto& slice = geom[intSlice];
-                if (intSlicePosition >= 0 && intSlicePosition < static_cast<int>(slice.size())) {
-                    if (slice[intSlicePosition])
-                        return true;
-                }
+    // Not one of the game's levels: a short run of ring gates that come and go, every other one open
+    // while the rest are shut, for trying phase walls out with --level phaseGateLevel.
+    void planPhaseGateLevel(std::vector<GenerationStep>& steps) {
+        planEmptyLevel(steps, 2000);
+
+        int currSlice = 50;
+
+        steps.push_back([this, currSlice] {
+            phaseSchedules[0] = PhaseSchedule(120, 60, 0);
+            phaseSchedules[1] = PhaseSchedule(120, 60, 60);
+            Grid& geom = changeShape().geom;
+            int slice = currSlice;
+            for (int gate = 0; gate < 4; ++gate) {
+                std::fill(geom[slice].begin(), geom[slice].end(), static_cast<unsigned char>(1 + gate % 2));
+                slice += 10;
             }
-            return false;
-        };
+        });
+        currSlice += 4 * 10;
 
-        SimSpacePosition sp0, sp1, sp2, sp3;
-        playerCornersInSimSpace(testPlayerSlice, testPlayerPosition, playerWidthInSliceDiv2, playerHeightSliceDirDiv2, sp0, sp1, sp2, sp3);
+        currSlice += 40;
+        planLevelEnd(steps, currSlice);
+    }
 
+    void generateLevel() {
+        PROFILE_SCOPE("generateLevel");
+        std::vector<GenerationStep> steps;
+        planLevel(steps);
+        runGeneration(steps);
+    }
 
-        return testSinglePoint(sp0) || testSinglePoint(sp1) || testSinglePoint(sp2) || testSinglePoint(sp3);;
+    void generateLevel2() {
+        PROFILE_SCOPE("generateLevel2");
+        std::vector<GenerationStep> steps;
+        planLevel2(steps);
+        runGeneration(steps);
     }
-    // returns true if there was a collision
-    bool incrPlayerPosition(float val) {
-        const float modulo = static_cast<float>(2 * sliceWidth + 2 * sliceHeight);
-        float newPlayerPosition = fmodf(playerPosition + modulo + val, modulo);
-        if (collides(playerSlice, newPlayerPosition)) {
-            return true;
-        }
-        playerPosition = newPlayerPosition;
-        return false;
+
+    void generateLevel3() {
+        PROFILE_SCOPE("generateLevel3");
+        std::vector<GenerationStep> steps;
+        planLevel3(steps);
+        runGeneration(steps);
     }
 
-    bool incrPlayerSlice(float val) {
-        float newPlayerSlice = playerSlice + val;
-        if (collides(newPlayerSlice, playerPosition)) {
-            return true;
+    // the steps that build level 0, 1, 2 or phaseGateLevel (anything else is 2) from a seed; random
+    // must not be drawn from while they run
+    void planGeneration(int level, uint32_t seed, std::vector<GenerationStep>& steps) {
+        steps.push_back([this, seed] { random.reseed(seed); });
+        if (level == 0) {
+            planLevel(steps);
+        }
+        else if (level == 1) {
+            planLevel2(steps);
+        }
+        else if (level == phaseGateLevel) {
+            planPhaseGateLevel(steps);
+        }
+        else {
+            planLevel3(steps);
         }
-        playerSlice = newPlayerSlice;
-        return false;
     }
 
-    float dangerZoneT() {
-        float t = 1.0f - (playerSlice - float(dangerZone)) / float(numWarningZones);
-        return std::min(1.0f, std::max(0.0f, t));
-    }
-    void loadBackgroundImage(const char fname[]) {
-        backgroundImage.reset(new SafeImage(fname));
+    // builds level 0, 1, 2 or phaseGateLevel (anything else is 2) from a seed
+    void generate(int level, uint32_t seed) {
+        PROFILE_SCOPE("generate");
+        std::vector<GenerationStep> steps;
+        planGeneration(level, seed, steps);
+        runGeneration(steps);
     }
 
-    void drawBackground() {
-        if (backgroundImage.get()) {
-            DrawAllGrid(transformer.screenCenter, transformer.sliceAtCenter, [=](int slice, int sliceIndex, Color& col, bool& render) {
-                render = false;
-                if (slice >= 0 && slice < backgroundImage->image.width && sliceIndex >= 0 && sliceIndex < backgroundImage->image.height) {
-                    col = backgroundImage->color(slice, sliceIndex);
-                    render = true;
-                }
-                });
+    // The phase groups whose walls are there at tick, as phaseBit()s; collision and drawing go by
+    // this, worked out once a tick, instead of by the cells.
+    uint32_t solidPhasesAt(int tick) const {
+        uint32_t solid = 0;
+        for (int group = 1; group <= maxPhaseGroups; ++group) {
+            if ((phaseGroups & phaseBit(group)) && phaseSchedules[group - 1].solidAt(tick))
+                solid |= phaseBit(group);
+        }
+        return solid;
+    }
+
+    static uint32_t phaseBit(int group) { return 1u << (group - 1); }
+
+    // whether a cell of geom is a wall while solidPhases are
+    static bool cellSolid(unsigned char cell, uint32_t solidPhases) {
+        return cell == solidCell || (cell != 0 && (solidPhases & phaseBit(cell)) != 0);
+    }
+
+    // Whether f(mask) is true for the walls that are always there or those of a group in
+    // solidPhases; stops at the first that is.
+    template<typename F>
+    bool anyWallMask(uint32_t solidPhases, const F& f) const {
+        if (f(shape->walls))
+            return true;
+        for (uint32_t groups = solidPhases & phaseGroups, group = 0; groups; groups >>= 1, ++group) {
+            if ((groups & 1u) && f(shape->phaseWalls[group]))
+                return true;
+        }
+        return false;
+    }
+
+    bool collides(float testPlayerSlice, float testPlayerPosition, uint32_t solidPhases) const {
+        // most of the time nothing is within reach of the player at all
+        if (shape->clearance.at(static_cast<int>(floorf(testPlayerSlice)), static_cast<int>(floorf(testPlayerPosition))) > playerFootprint.reach())
+            return false;
+        const int firstSlice = playerFootprint.firstSlice(testPlayerSlice);
+        const int firstPosition = playerFootprint.firstPosition(testPlayerPosition);
+        return anyWallMask(solidPhases, [&](const CollisionMask& mask) {
+            return mask.overlaps(playerFootprint, firstSlice, firstPosition);
+        });
+    }
+
+    // Whether the player's box at (slice, position) runs into a wall moving delta slices, and if so
+    // the time of impact: the fraction of delta it gets before touching it. The box covers every cell
+    // collides() would at every point along the way, however far it goes. A box that overlaps a wall
+    // already is only stopped by what is at the end of the move. A move of a cell or less can't jump
+    // anything, so if its end is clear so is the way there. The sweep is of the box round the player's
+    // footprint, so for a shape that isn't a box the impact may come a little early.
+    //
+    // The work past collides() is where it goes: a collides() is a clearance lookup and a word per
+    // footprint row, where a sweep near a wall is the lookup, a word or two for each column the box
+    // covers (or each row, round the slice) ORed across all the cells crossed, and a collides() at
+    // the end for a box that starts on a wall. So a sweep costs a few collides(), not one; see the
+    // bench's sweep and collides benchmarks. A tick makes two sweeps a player, and in open space the
+    // clearance lookup alone answers.
+    bool sweepSlices(float slice, float position, float delta, uint32_t solidPhases, float& impact) const {
+        impact = 0.0f;
+        if (sweepStartsClear(slice, position, delta))
+            return false;
+        if (fabsf(delta) <= 1.0f && !collides(slice + delta, position, solidPhases))
+            return false;
+        const float back = slice - playerHeightSliceDirDiv2;
+        const float front = slice + playerHeightSliceDirDiv2;
+        const int backCell = static_cast<int>(floorf(back));
+        const int frontCell = static_cast<int>(floorf(front));
+        // from the far side of the box as it is to the leading side of it at the end, so one scan
+        // also says whether the box starts on a wall
+        const int from = delta > 0.0f ? backCell : frontCell;
+        const int to = static_cast<int>(floorf((delta > 0.0f ? front : back) + delta));
+        const int firstPosition = static_cast<int>(floorf(position - playerWidthInSliceDiv2));
+        const int boxCells = static_cast<int>(floorf(position + playerWidthInSliceDiv2)) - firstPosition + 1;
+        int hit = CollisionMask::none;
+        bool found = false;
+        anyWallMask(solidPhases, [&](const CollisionMask& mask) {
+            // no further than what an earlier mask hit
+            const int wall = mask.firstSliceWithWall(firstPosition, boxCells, from, found ? hit : to);
+            if (wall != CollisionMask::none) {
+                hit = wall;
+                found = true;
+            }
+            return false;
+        });
+        if (!found)
+            return false;
+        if (hit >= backCell && hit <= frontCell)
+            return collides(slice + delta, position, solidPhases);
+        impact = delta > 0.0f ? (static_cast<float>(hit) - front) / delta : (back - static_cast<float>(hit + 1)) / -delta;
+        return true;
+    }
+
+    // sweepSlices() round the slice, moving delta positions
+    bool sweepPositions(float slice, float position, float delta, uint32_t solidPhases, float& impact) const {
+        impact = 0.0f;
+        if (sweepStartsClear(slice, position, delta))
+            return false;
+        if (fabsf(delta) <= 1.0f && !collides(slice, position + delta, solidPhases))
+            return false;
+        const float edge = delta > 0.0f ? position + playerWidthInSliceDiv2 : position - playerWidthInSliceDiv2;
+        const int edgeCell = static_cast<int>(floorf(edge));
+        const int boxCells = static_cast<int>(floorf(position + playerWidthInSliceDiv2)) - static_cast<int>(floorf(position - playerWidthInSliceDiv2)) + 1;
+        // from just behind the box, so one scan also says whether the box starts on a wall
+        const int direction = delta > 0.0f ? 1 : -1;
+        const int behind = edgeCell - direction * boxCells;
+        const int cellsCrossed = static_cast<int>(floorf(edge + delta)) - behind;
+        const int firstSlice = static_cast<int>(floorf(slice - playerHeightSliceDirDiv2));
+        const int lastSlice = static_cast<int>(floorf(slice + playerHeightSliceDirDiv2));
+        int steps = INT_MAX;
+        anyWallMask(solidPhases, [&](const CollisionMask& mask) {
+            const int toWall = mask.stepsToWall(firstSlice, lastSlice, behind, cellsCrossed);
+            if (toWall != CollisionMask::none)
+                steps = std::min(steps, toWall);
+            return false;
+        });
+        if (steps == INT_MAX)
+            return false;
+        if (steps <= boxCells)
+            return collides(slice, position + delta, solidPhases);
+        const int hit = behind + direction * steps;
+        impact = delta > 0.0f ? (static_cast<float>(hit) - edge) / delta : (edge - static_cast<float>(hit + 1)) / -delta;
+        return true;
+    }
+
+    // nothing within reach of a box moving delta from (slice, position), going by the clearance
+    bool sweepStartsClear(float slice, float position, float delta) const {
+        const int reach = playerFootprint.reach() + static_cast<int>(ceilf(fabsf(delta)));
+        return shape->clearance.at(static_cast<int>(floorf(slice)), static_cast<int>(floorf(position))) > reach;
+    }
+
+    // how much of a move of val to make when it hits something at impact
+    static float moveBeforeImpact(float val, float impact) {
+        const float gap = 0.01f; // left between the player and the wall
+        if (fabsf(val) <= 1.0f)
+            return 0.0f;
+        const float move = fabsf(val) * impact - gap;
+        return move > 0.0f ? (val > 0.0f ? move : -move) : 0.0f;
+    }
+
+    // Move a player at (slice, position) by val, with the phase groups in solidPhases there; returns
+    // true if there was a collision. A move of a cell or less leaves the player where it was, and a
+    // longer one stops it just short of the wall. Only reads the level, so any number of players can
+    // share one.
+    bool incrPlayerPosition(float slice, float& position, float val, uint32_t solidPhases) const {
+        const float modulo = static_cast<float>(2 * sliceWidth + 2 * sliceHeight);
+        float impact;
+        if (sweepPositions(slice, position, val, solidPhases, impact)) {
+            position = fmodf(position + modulo + moveBeforeImpact(val, impact), modulo);
+            return true;
+        }
+        position = fmodf(position + modulo + val, modulo);
+        return false;
+    }
+
+    bool incrPlayerSlice(float& slice, float position, float val, uint32_t solidPhases) const {
+        float impact;
+        if (sweepSlices(slice, position, val, solidPhases, impact)) {
+            slice += moveBeforeImpact(val, impact);
+            return true;
         }
+        slice = slice + val;
+        return false;
+    }
+
+    float dangerZoneT() {
+        float t = 1.0f - (playerSlice - float(dangerZone)) / float(numWarningZones);
+        return std::min(1.0f, std::max(0.0f, t));
+    }
+    void loadBackgroundImage(const char fname[]) {
+        backgroundImage.reset(new SafeImage(fname));
+    }
+
+    void drawBackground() {
+        PROFILE_SCOPE("drawBackground");
+        projectVisibleGrid(transformer.sliceAtCenter);
+        prepareBackground(transformer.sliceAtCenter);
+        DrawList::submit(backgroundLists);
     }
 
     // sim space constants
@@ -882,38 +1789,198 @@ public:
     const int sliceHeight = 60; // number of pixels in y axis
     const int sliceSize = sliceWidth * 2 + sliceHeight * 2;
 
-    const float playerHeightSliceDirDiv2 = 0.5f;
-    const float playerWidthInSliceDiv2 = 0.5f;
+    // the cells the player covers, and the box round them; setPlayerFootprint() changes all three
+    Footprint playerFootprint = Footprint::box(1, 1);
+    float playerHeightSliceDirDiv2 = 0.5f;
+    float playerWidthInSliceDiv2 = 0.5f;
+
+    void setPlayerFootprint(const Footprint& footprint) {
+        playerFootprint = footprint;
+        playerHeightSliceDirDiv2 = footprint.halfHeight();
+        playerWidthInSliceDiv2 = footprint.halfWidth();
+    }
+
+    // Cells of geom are 0 where it is open, solidCell for a wall and 1 to maxPhaseGroups for a wall
+    // that comes and goes with its phase group.
+    static const unsigned char solidCell = 255;
+    static const int maxPhaseGroups = 8;
+    static bool validCell(unsigned char value) { return value == 0 || value == solidCell || value <= maxPhaseGroups; }
+
+    // What the level is made of: its cells and everything built from them. It is held read-only, so
+    // a game and the views that draw it (see copyLevel()) share one; whatever changes it goes through
+    // changeShape().
+    typedef std::vector< std::vector<unsigned char> > Grid;
+    typedef struct LevelShape {
+        // grid space
+        Grid geom;
+        ClearanceField clearance; // of geom; whatever changes geom calls indexGeometry()
+        CollisionMask walls;      // likewise, of the walls that are always there
+        CollisionMask phaseWalls[maxPhaseGroups]; // of each group's cells, from indexGeometry() too
+        // world space: position of top-left point of each geom pixel; includes extra row/element to bake end
+        std::vector< std::vector<Vector3> > worldGeom;
+    } LevelShape;
+    std::shared_ptr<const LevelShape> shape;
+
+    static unsigned nextLevelId() {
+        static std::atomic<unsigned> next(0);
+        return ++next;
+    }
+
+    // this level's shape to change, copied first if another level shares it
+    LevelShape& changeShape() {
+        if (!shape || shape.use_count() > 1) {
+            MemoryTagScope tag(MemoryTag::Level);
+            shape = shape ? std::make_shared<LevelShape>(*shape) : std::make_shared<LevelShape>();
+        }
+        // only this level holds it, and it was made non-const above
+        return const_cast<LevelShape&>(*shape);
+    }
 
-    // grid space
-    std::vector< std::vector<unsigned char> > geom;
+    PhaseSchedule phaseSchedules[maxPhaseGroups];
+    uint32_t phaseGroups = 0;                 // phaseBit()s of the groups that have cells
+
+    // Level edits (see setCell())
+    static const int editChunkSlices = 16;
+    typedef struct CellEdit {
+        int slice;
+        unsigned short position;
+        unsigned char before;
+    } CellEdit;
+    std::vector<CellEdit> editLog;          // every change since indexGeometry(), oldest first
+    std::vector<size_t> editSteps;          // where each closed undo step ends in editLog
+    std::vector<unsigned char> dirtyChunks; // changed since applyEdits()
+    uint32_t newPhaseGroups = 0;            // groups edits gave their first cells, to build masks for
+    unsigned geometryVersion = 0;           // goes up whenever indexGeometry() or applyEdits() changes the lookups
+    const unsigned levelId = nextLevelId(); // no two levels alive or gone share one, unlike their addresses
+    Random random; // everything generation picks comes from here, so a level is reproducible from its seed
+    std::vector<unsigned char> maze2Path; // a way through the maze addMaze2Lines() is building, as havePath() leaves it
     float playerSlice; // which slice the player is on
     float playerPosition; // position on slice
 
     // world space
     const float                         worldWidth = static_cast<float>(400);
     const float                         worldHeight = static_cast<float>(300);
-    std::vector< std::vector<Vector3> > worldGeom; // position of top-left point of each geom pixel; includes extra row/element to bake end 
 
     // Display Constants
     Color playerColor;
+    const Color phaseWallColor = { 170, 90, 255, 255 };
     const float slicesBeforePlayer = 20.0f;
     const float slicesPerScreen = 30.0f;
 
     // Danger Zone
     int dangerZone; // zone in which player is killed
-    const int startingDangerZone = -40;
+    static const int startingDangerZone = -40;
     int numWarningZones = 50;
     int winningZone;
 
     // Visuals
+    int animTick = 0; // sim tick the zone overlays animate with, set by the owning game state
     std::unique_ptr<SafeImage> backgroundImage;
 
     LevelTransformer transformer;
 
   private:
-      void DrawPlayer(const Vector2& screenCenter, float sliceAtCenter)
+      static const int slicesPerJob = 4;
+
+      // Render preparation scratch, reused between frames. Each pass keeps one list per job so the
+      // lists can be submitted in slice order no matter which thread filled them.
+      Vector2* projectedGrid = nullptr; // from the frame arena
+      int projectedSliceAtCenter = INT_MIN;
+      std::vector<DrawList> backgroundLists;
+      std::vector<DrawList> solidLists;
+      std::vector<DrawList> overlayLists;
+      DrawList playerList;
+
+      int numSlicesToIterate() const { return static_cast<int>(slicesPerScreen) + 2; }
+
+      // Screen position of the top-left corner of element jj of a visible slice; only valid for
+      // slices projected by the last projectVisibleGrid() call.
+      const Vector2* projectedRow(int sliceIndex) const {
+          const int row = projectedSliceAtCenter + 1 - sliceIndex;
+          assert(row >= 0 && row <= numSlicesToIterate());
+          return &projectedGrid[size_t(row) * (sliceSize + 1)];
+      }
+
+      // Every visible slice corner is shared by up to four cells and three passes, so project them
+      // all once up front.
+      void projectVisibleGrid(float sliceAtCenter)
+      {
+          PROFILE_SCOPE("projectVisibleGrid");
+          const int numRows = numSlicesToIterate() + 1;
+          PROFILE_COUNT(ProfileCounter::ProjectedVertices, static_cast<long long>(numRows) * (sliceSize + 1));
+          projectedSliceAtCenter = static_cast<int>(sliceAtCenter);
+          projectedGrid = frameArena().allocateArray<Vector2>(size_t(numRows) * (sliceSize + 1));
+          jobSystem().parallelFor(numRows, slicesPerJob, [&](int begin, int end) {
+              for (int rr = begin; rr < end; ++rr) {
+                  const int sliceIndex = projectedSliceAtCenter + 1 - rr;
+                  if (sliceIndex < 0 || sliceIndex >= static_cast<int>(shape->worldGeom.size()))
+                      continue;
+                  const std::vector<Vector3>& sliceWorld = shape->worldGeom[sliceIndex];
+                  Vector2* row = &projectedGrid[size_t(rr) * (sliceSize + 1)];
+                  for (int jj = 0; jj <= sliceSize; ++jj) {
+                      row[jj] = transformer.worldToScreen(sliceWorld[jj]);
+                  }
+              }
+          });
+      }
+
+      // Runs prepareSlice(currSliceIndex, list) for every visible slice, farthest first, spread over
+      // jobs of slicesPerJob slices each.
+      template<typename F>
+      void prepareVisibleSlices(float sliceAtCenter, std::vector<DrawList>& lists, const F& prepareSlice)
+      {
+          prepareVisibleLayers(sliceAtCenter, lists, 1, [&](int currSliceIndex, DrawList* layers) {
+              prepareSlice(currSliceIndex, layers[0]);
+          });
+      }
+
+      // prepareVisibleSlices() into numLayers lists a job, which prepareSlice(currSliceIndex, layers)
+      // adds to as layers[layer]; DrawList::submit(lists, numLayers, layer) draws one layer.
+      template<typename F>
+      void prepareVisibleLayers(float sliceAtCenter, std::vector<DrawList>& lists, int numLayers, const F& prepareSlice)
       {
+          const int numSlices = numSlicesToIterate();
+          const int sliceAtCenterInt = static_cast<int>(sliceAtCenter);
+          const int numJobs = (numSlices + slicesPerJob - 1) / slicesPerJob;
+          MemoryTagScope tag(MemoryTag::Render);
+          lists.resize(size_t(numJobs) * numLayers);
+          jobSystem().parallelFor(numJobs, 1, [&](int begin, int end) {
+              MemoryTagScope tag(MemoryTag::Render);
+              for (int ll = begin; ll < end; ++ll) {
+                  DrawList* layers = &lists[size_t(ll) * numLayers];
+                  for (int layer = 0; layer < numLayers; ++layer) {
+                      layers[layer].clear();
+                      layers[layer].triangles.reserve(size_t(slicesPerJob) * sliceSize * 2); // worst case, so steady state never allocates
+                  }
+                  const int lastSlice = std::min(numSlices, (ll + 1) * slicesPerJob);
+                  for (int ii = ll * slicesPerJob; ii < lastSlice; ++ii) {
+                      int currSliceIndex = sliceAtCenterInt - ii;
+                      if (currSliceIndex >= 0 && currSliceIndex < (static_cast<int>(shape->worldGeom.size()) - 1)) {
+                          prepareSlice(currSliceIndex, layers);
+                      }
+                  }
+              }
+          });
+      }
+
+      void prepareBackground(float sliceAtCenter)
+      {
+          if (!backgroundImage.get()) {
+              backgroundLists.clear();
+              return;
+          }
+          PrepareAllGrid(sliceAtCenter, backgroundLists, [=](int slice, int sliceIndex, Color& col, bool& render) {
+              render = false;
+              if (slice >= 0 && slice < backgroundImage->image.width && sliceIndex >= 0 && sliceIndex < backgroundImage->image.height) {
+                  col = backgroundImage->color(slice, sliceIndex);
+                  render = true;
+              }
+              });
+      }
+
+      void PreparePlayer(DrawList& list)
+      {
+          PROFILE_SCOPE("PreparePlayer");
           SimSpacePosition sp0, sp1, sp2, sp3;
           playerCornersInSimSpace(playerSlice, playerPosition, playerWidthInSliceDiv2, playerHeightSliceDirDiv2, sp0, sp1, sp2, sp3);
           const Vector3 player0World = transformer.simToWorldFloat(sp0.slice, sp0.positionInSlice);
@@ -927,159 +1994,317 @@ public:
           const Vector2 p3 = transformer.worldToScreen(player3World);
           const Vector2 p12 = Vector2Lerp(p1, p2, 0.6f);
           const Vector2 p03 = Vector2Lerp(p0, p3, 0.6f);
-          DrawTriangle(p0, p1, p12, playerColor);
-          DrawTriangle(p0, p12, p03, playerColor);
-          DrawTriangle(p03, p12, p2, BLUE);
-          DrawTriangle(p03, p2, p3, BLUE);
+          list.clear();
+          list.triangle(p0, p1, p12, playerColor);
+          list.triangle(p0, p12, p03, playerColor);
+          list.triangle(p03, p12, p2, BLUE);
+          list.triangle(p03, p2, p3, BLUE);
       }
 
-      void DrawAllGrid(const Vector2& screenCenter, float sliceAtCenter, std::function<void(int, int, Color&, bool&)> ColorCallback)
+      // ColorCallback(slice, sliceIndex, Color& col, bool& render) is called from several jobs at once
+      template<typename ColorFn>
+      void PrepareAllGrid(float sliceAtCenter, std::vector<DrawList>& lists, const ColorFn& ColorCallback)
       {
-          const int numSlicesToIterate = static_cast<int>(slicesPerScreen) + 2;
-          const int sliceAtCenterInt = static_cast<int>(sliceAtCenter);
-
-          for (int ii = 0; ii < numSlicesToIterate; ++ii) {
-              int currSliceIndex = sliceAtCenterInt - ii;
-              if (currSliceIndex >= 0 && currSliceIndex < (static_cast<int>(worldGeom.size()) - 1)) {
-                  assert(size_t(currSliceIndex) < worldGeom.size());
-                  const std::vector<Vector3>& sliceWorld = worldGeom[currSliceIndex];
-                  const std::vector<Vector3>& nextSliceWorld = worldGeom[currSliceIndex + 1];
-                  assert(sliceWorld.size() <= size_t(sliceSize + 1));
-                  //       b11-p3--------p2-b12
-                  //        |\   \xxxxxx/   /|
-                  //        | a11-p0--p1-a12 |
-                  //        |  |          |  |
-                  //        | a21--------a22 |
-                  //        |/              \|
-                  //       b21--------------b22
-                  for (int jj = 0; jj < sliceSize; jj++) {
-                      const Vector2 p0 = transformer.worldToScreen(sliceWorld[jj]);
-                      const Vector2 p1 = transformer.worldToScreen(sliceWorld[jj + 1]);
-                      const Vector2 p2 = transformer.worldToScreen(nextSliceWorld[jj + 1]);
-                      const Vector2 p3 = transformer.worldToScreen(nextSliceWorld[jj]);
-                      Color col;
-                      bool render;
-                      ColorCallback(currSliceIndex, jj, col, render);
-                      if (render) {
-                          DrawTriangle(p2, p1, p0, col);
-                          DrawTriangle(p3, p2, p0, col);
-                      }
+          PROFILE_SCOPE("PrepareAllGrid");
+          prepareVisibleSlices(sliceAtCenter, lists, [&](int currSliceIndex, DrawList& list) {
+              const Vector2* sliceScreen = projectedRow(currSliceIndex);
+              const Vector2* nextSliceScreen = projectedRow(currSliceIndex + 1);
+              //       b11-p3--------p2-b12
+              //        |\   \xxxxxx/   /|
+              //        | a11-p0--p1-a12 |
+              //        |  |          |  |
+              //        | a21--------a22 |
+              //        |/              \|
+              //       b21--------------b22
+              for (int jj = 0; jj < sliceSize; jj++) {
+                  Color col;
+                  bool render;
+                  ColorCallback(currSliceIndex, jj, col, render);
+                  if (render) {
+                      const Vector2& p0 = sliceScreen[jj];
+                      const Vector2& p1 = sliceScreen[jj + 1];
+                      const Vector2& p2 = nextSliceScreen[jj + 1];
+                      const Vector2& p3 = nextSliceScreen[jj];
+                      list.triangle(p2, p1, p0, col);
+                      list.triangle(p3, p2, p0, col);
                   }
               }
+          });
+      }
+
+      // one layer for the walls that are always there, then one for each phase group if there are any
+      int solidLayers() const { return (phaseGroups | newPhaseGroups) ? 1 + maxPhaseGroups : 1; }
+
+      void writeCell(int slice, int position, unsigned char value) {
+          changeShape().geom[slice][position] = value;
+          dirtyChunks[slice / editChunkSlices] = 1;
+          assert(validCell(value));
+          if (value != 0 && value != solidCell && !((phaseGroups | newPhaseGroups) & phaseBit(value))) {
+              newPhaseGroups |= phaseBit(value);
           }
       }
 
-      void DrawGridSolid(const Vector2& screenCenter, float sliceAtCenter, const Color& col)
+      // Walls into layers of lists by phase group (see solidLayers()), so whether a group is drawn
+      // is only whether its layer is submitted.
+      void PrepareGridSolid(float sliceAtCenter, std::vector<DrawList>& lists, const Color& col)
       {
-          const int numSlicesToIterate = static_cast<int>(slicesPerScreen) + 2;
-          const int sliceAtCenterInt = static_cast<int>(sliceAtCenter);
-
-          for (int ii = 0; ii < numSlicesToIterate; ++ii) {
-              int currSliceIndex = sliceAtCenterInt - ii;
-              if (currSliceIndex >= 0 && currSliceIndex < (static_cast<int>(worldGeom.size()) - 1)) {
-                  assert(size_t(currSliceIndex) < worldGeom.size());
-                  const std::vector<Vector3>& sliceWorld = worldGeom[currSliceIndex];
-                  const std::vector<Vector3>& nextSliceWorld = worldGeom[currSliceIndex + 1];
-                  assert(sliceWorld.size() <= size_t(sliceSize + 1));
-                  const std::vector<unsigned char>& slice = geom[currSliceIndex];
-                  //       b11-p3--------p2-b12
-                  //        |\   \xxxxxx/   /|
-                  //        | a11-p0--p1-a12 |
-                  //        |  |          |  |
-                  //        | a21--------a22 |
-                  //        |/              \|
-                  //       b21--------------b22
-                  for (int jj = 0; jj < sliceSize; jj++) {
-                      if (!slice[jj]) continue;
-
-                      const Vector2 p0 = transformer.worldToScreen(sliceWorld[jj]);
-                      const Vector2 p1 = transformer.worldToScreen(sliceWorld[jj + 1]);
-                      const Vector2 p2 = transformer.worldToScreen(nextSliceWorld[jj + 1]);
-                      const Vector2 p3 = transformer.worldToScreen(nextSliceWorld[jj]);
-                      DrawTriangle(p2, p1, p0, col);
-                      DrawTriangle(p3, p2, p0, col);
-                  }
+          PROFILE_SCOPE("PrepareGridSolid");
+          prepareVisibleLayers(sliceAtCenter, lists, solidLayers(), [&](int currSliceIndex, DrawList* layers) {
+              const Vector2* sliceScreen = projectedRow(currSliceIndex);
+              const Vector2* nextSliceScreen = projectedRow(currSliceIndex + 1);
+              const std::vector<unsigned char>& slice = shape->geom[currSliceIndex];
+              for (int jj = 0; jj < sliceSize; jj++) {
+                  const unsigned char cell = slice[jj];
+                  if (!cell) continue;
+
+                  const bool phase = cell != solidCell;
+                  DrawList& list = layers[phase ? cell : 0];
+                  const Color& cellColor = phase ? phaseWallColor : col;
+                  const Vector2& p0 = sliceScreen[jj];
+                  const Vector2& p1 = sliceScreen[jj + 1];
+                  const Vector2& p2 = nextSliceScreen[jj + 1];
+                  const Vector2& p3 = nextSliceScreen[jj];
+                  list.triangle(p2, p1, p0, cellColor);
+                  list.triangle(p3, p2, p0, cellColor);
               }
-          }
+          });
       }
 };
 
 void LevelGeometry::doRender()
 {
-    const float centerX = static_cast<float>(GetScreenWidth() / 2);
-    const float centerY = static_cast<float>(GetScreenHeight() / 2);
-    const Vector2 screenCenter = { centerX, centerY };
+    PROFILE_SCOPE("LevelGeometry::doRender");
     const float sliceAtCenter = playerSlice + slicesBeforePlayer;
 
-
-    //DrawGrid(screenCenter, sliceAtCenter, [](int, int, Color& col, bool& render) {col = RED; render = true; });
-    drawBackground();
-    DrawGridSolid(screenCenter, sliceAtCenter, RED);
-    DrawPlayer(screenCenter, sliceAtCenter);
-    DrawAllGrid(screenCenter, sliceAtCenter, [=](int slice, int sliceIndex, Color& col, bool& render) {
+    // all vertex work happens in the prepare calls, possibly on other threads; the lists are
+    // submitted afterwards in the original draw order
+    projectVisibleGrid(sliceAtCenter);
+    prepareBackground(sliceAtCenter);
+    PrepareGridSolid(sliceAtCenter, solidLists, RED);
+    PreparePlayer(playerList);
+    PrepareAllGrid(sliceAtCenter, overlayLists, [=](int slice, int sliceIndex, Color& col, bool& render) {
             render = false;
             if (slice <= dangerZone) {
                 col = RED;
                 render = true;
-                float wave = 0.1f * (0.5f * sinf(float(slice) / 3.0f + float(gSimTick) * 0.4f) + 0.5f);
+                float wave = 0.1f * (0.5f * sinf(float(slice) / 3.0f + float(animTick) * 0.4f) + 0.5f);
                 col.a = static_cast<unsigned char>(255.0f * (0.3 + wave));
             }
             else if (slice >= winningZone) {
                 col = GREEN;
                 render = true;
-                float wave = 0.1f * (0.5f * sinf(float(slice) / 3.0f + float(gSimTick) * 0.4f) + 0.5f);
+                float wave = 0.1f * (0.5f * sinf(float(slice) / 3.0f + float(animTick) * 0.4f) + 0.5f);
                 col.a = static_cast<unsigned char>(255.0f * (0.3 + wave));
             }
             else if (slice - dangerZone <= numWarningZones) {
                 float t = 1 - float(slice - dangerZone) / float(numWarningZones);
                 col = YELLOW;
                 render = true;
-                float wave = 0.1f * (0.5f * sinf(float(slice)/3.0f + float(gSimTick) * 0.4f) + 0.5f);
+                float wave = 0.1f * (0.5f * sinf(float(slice)/3.0f + float(animTick) * 0.4f) + 0.5f);
                 col.a = static_cast<unsigned char>(255.0f * t * (0.3 + wave));
             }
         });
+
+    PROFILE_SCOPE("submit");
+    DrawList::submit(backgroundLists);
+    DrawList::submit(solidLists, solidLayers(), 0);
+    const uint32_t solidPhases = solidPhasesAt(animTick);
+    for (int group = 1; group < solidLayers(); ++group) {
+        if (solidPhases & phaseBit(group))
+            DrawList::submit(solidLists, solidLayers(), group);
+    }
+    playerList.submit();
+    DrawList::submit(overlayLists);
+}
+
+enum class PlayerDirection { CCW, CW, IN, OUT, NONE };
+
+const float playerHorizontalSpeed = 0.75f;
+const float playerVerticalSpeed = 0.5f;
+
+// What the movement rules read and write for one player each tick.
+typedef struct PlayerMotion {
+    PlayerMotion(float slice = 0.0f, float position = 0.0f)
+        : slice(slice)
+        , position(position)
+        , direction(PlayerDirection::IN)
+        , currHorizontalSpeed(0)
+        , currVerticalSpeed(playerVerticalSpeed)
+        , desiredHorizontalSpeed(0)
+        , desiredVerticalSpeed(playerVerticalSpeed) {}
+
+    float slice;
+    float position;
+    PlayerDirection direction;
+    float currHorizontalSpeed;
+    float currVerticalSpeed;
+    float desiredHorizontalSpeed;
+    float desiredVerticalSpeed;
+} PlayerMotion;
+
+// One tick of player movement through lg, steered by the held buttons. controls are
+// LevelGameState::controlFlags() and solidPhases lg.solidPhasesAt() the tick. Returns true if the
+// player ran into a wall, and where it first did in collision. Shared by LevelGameState and
+// BatchEnv so both play by the same rules.
+bool stepPlayer(const LevelGeometry& lg, uint32_t controls, uint32_t solidPhases, const InputFrame& input, PlayerMotion& motion, SimSpacePosition& collision)
+{
+    const bool classicControls = (controls & 1u) != 0;
+    const bool absoluteControls = (controls & 2u) != 0;
+
+    auto setPlayerDir = [&motion](PlayerDirection dir) {
+        const float verticalSpeedContiniousScale = 0.5f;
+        motion.direction = dir;
+        if (dir == PlayerDirection::IN)
+            motion.desiredVerticalSpeed = playerVerticalSpeed * verticalSpeedContiniousScale;
+        else if (dir == PlayerDirection::OUT)
+            motion.desiredVerticalSpeed = -playerVerticalSpeed * verticalSpeedContiniousScale;
+        else if (dir == PlayerDirection::CCW)
+            motion.desiredHorizontalSpeed = -playerHorizontalSpeed;
+        else if (dir == PlayerDirection::CW)
+            motion.desiredHorizontalSpeed = playerHorizontalSpeed;
+        else
+            motion.desiredHorizontalSpeed = motion.desiredVerticalSpeed = 0;
+    };
+
+    if (classicControls) {
+        if (input.down(BUTTON_UP)) setPlayerDir(PlayerDirection::IN);
+        if (input.down(BUTTON_DOWN)) setPlayerDir(PlayerDirection::OUT);
+        if (input.down(BUTTON_LEFT)) setPlayerDir(PlayerDirection::CCW);
+        if (input.down(BUTTON_RIGHT)) setPlayerDir(PlayerDirection::CW);
+    }
+    else {
+        if (motion.position < lg.sliceWidth) {
+            if (input.down(BUTTON_UP)) setPlayerDir(PlayerDirection::OUT);
+            if (input.down(BUTTON_DOWN)) setPlayerDir(PlayerDirection::IN);
+            if (input.down(BUTTON_LEFT)) setPlayerDir(PlayerDirection::CCW);
+            if (input.down(BUTTON_RIGHT)) setPlayerDir(PlayerDirection::CW);
+        }
+        else if (motion.position < lg.sliceWidth + lg.sliceHeight) {
+            if (input.down(BUTTON_UP)) setPlayerDir(PlayerDirection::CCW);
+            if (input.down(BUTTON_DOWN)) setPlayerDir(PlayerDirection::CW);
+            if (input.down(BUTTON_LEFT)) setPlayerDir(PlayerDirection::IN);
+            if (input.down(BUTTON_RIGHT)) setPlayerDir(PlayerDirection::OUT);
+        }
+        else if (motion.position < 2*lg.sliceWidth + lg.sliceHeight) {
+            if (input.down(BUTTON_UP)) setPlayerDir(PlayerDirection::IN);
+            if (input.down(BUTTON_DOWN)) setPlayerDir(PlayerDirection::OUT);
+            if (input.down(BUTTON_LEFT)) setPlayerDir(PlayerDirection::CW);
+            if (input.down(BUTTON_RIGHT)) setPlayerDir(PlayerDirection::CCW);
+        }
+        else {
+            if (input.down(BUTTON_UP)) setPlayerDir(PlayerDirection::CW);
+            if (input.down(BUTTON_DOWN)) setPlayerDir(PlayerDirection::CCW);
+            if (input.down(BUTTON_LEFT)) setPlayerDir(PlayerDirection::OUT);
+            if (input.down(BUTTON_RIGHT)) setPlayerDir(PlayerDirection::IN);
+        }
+    }
+
+    if (absoluteControls) {
+        bool wasCollision = false;
+        if (motion.direction == PlayerDirection::IN) {
+            wasCollision = lg.incrPlayerSlice(motion.slice, motion.position, playerVerticalSpeed, solidPhases);
+        }
+        else if (motion.direction == PlayerDirection::OUT) {
+            wasCollision = lg.incrPlayerSlice(motion.slice, motion.position, -playerVerticalSpeed, solidPhases);
+        }
+        else if (motion.direction == PlayerDirection::CCW) {
+            wasCollision = lg.incrPlayerPosition(motion.slice, motion.position, -playerHorizontalSpeed, solidPhases);
+        }
+        else if (motion.direction == PlayerDirection::CW) {
+            wasCollision = lg.incrPlayerPosition(motion.slice, motion.position, playerHorizontalSpeed, solidPhases);
+        }
+
+        if (wasCollision) {
+            collision = SimSpacePosition(motion.slice, motion.position);
+            motion.direction = PlayerDirection::NONE;
+        }
+        return wasCollision;
+    }
+
+    float vDelta = motion.desiredVerticalSpeed - motion.currVerticalSpeed;
+    motion.currVerticalSpeed = motion.currVerticalSpeed + std::max(-playerVerticalSpeed * .33f, std::min(playerVerticalSpeed * .33f, vDelta));
+    motion.currVerticalSpeed = std::max(-playerVerticalSpeed, std::min(playerVerticalSpeed, motion.currVerticalSpeed));
+    float hDelta = motion.desiredHorizontalSpeed - motion.currHorizontalSpeed;
+    motion.currHorizontalSpeed = motion.currHorizontalSpeed + std::max(-playerHorizontalSpeed * .33f, std::min(playerHorizontalSpeed * .33f, hDelta));
+    motion.currHorizontalSpeed = std::max(-playerHorizontalSpeed, std::min(playerHorizontalSpeed, motion.currHorizontalSpeed));
+
+    bool wasCollision = false;
+    if (lg.incrPlayerSlice(motion.slice, motion.position, motion.currVerticalSpeed, solidPhases)) {
+        //motion.currVerticalSpeed = motion.desiredVerticalSpeed = 0.0f;
+        collision = SimSpacePosition(motion.slice, motion.position);
+        wasCollision = true;
+    }
+    if (lg.incrPlayerPosition(motion.slice, motion.position, motion.currHorizontalSpeed, solidPhases)) {
+        //motion.currHorizontalSpeed = motion.desiredHorizontalSpeed = 0.0f;
+        if (!wasCollision)
+            collision = SimSpacePosition(motion.slice, motion.position);
+        wasCollision = true;
+    }
+    return wasCollision;
 }
 
 class GameState
 {
 public:
-    GameState()
+    GameState(AudioSink& audio)
         : finished(false)
+        , audio(audio)
     {
-        if (!gsInit) {
-            bump = LoadSound("Content/hitwall.wav");
-            dangerSound = LoadSound("Content/bg_buzz.wav");
-            deathSound = LoadSound("Content/explosion.wav");
-            winSound = LoadSound("Content/win.wav");
-        }
     }
-    virtual void Sim(float simTimeSeconds) = 0;
+    virtual ~GameState() {}
+
+    // Sim only sees input through InputFrame and only makes sound through the audio sink, so it
+    // runs the same with or without a window.
+    virtual void Sim(float simTimeSeconds, const InputFrame& input) = 0;
     virtual void Render() = 0;
 
     // not thread safe
     bool finished;
-    static Sound bump;
-    static Sound winSound;
-    static Sound dangerSound;
-    static Sound deathSound;
-
-private:
-    static bool gsInit;
+    AudioSink& audio;
 };
 
-bool GameState::gsInit = false;
-Sound GameState::bump;
-Sound GameState::winSound;
-Sound GameState::dangerSound;
-Sound GameState::deathSound;
-
 class LevelGameState : public GameState
 {
 public:
-    enum class PlayerDirection { CCW, CW, IN, OUT, NONE };
+    LevelGameState(AudioSink& audio, int level = 0, uint32_t seed = 1)
+        : LevelGameState(audio, NoLevel())
+    {
+        //lg.loadLevelFromImage("Content/test_level.png");
+        lg.generate(level, seed);
+        seedEffects(seed);
+    }
+
+    // A game whose level is left to steps, which must all run, in order, before anything else uses
+    // it; the window runs a few each frame rather than stop drawing while a level is generated.
+    LevelGameState(AudioSink& audio, int level, uint32_t seed, std::vector<LevelGeometry::GenerationStep>& steps)
+        : LevelGameState(audio, NoLevel())
+    {
+        lg.planGeneration(level, seed, steps);
+        seedEffects(seed);
+    }
+
+    // A game at the start of source's level, sharing its shape rather than generating it again; the
+    // window draws one of these with the state of a game simulated on another thread (see SimThread).
+    LevelGameState(AudioSink& audio, const LevelGameState& source)
+        : LevelGameState(audio, NoLevel())
+    {
+        lg.copyLevel(source.lg);
+        explosion.emitter.random = source.explosion.emitter.random;
+        sparks.emitter.random = source.sparks.emitter.random;
+    }
+
+private:
+    struct NoLevel {};
+
+    // from the level's seed, so effects differ from game to game but replay the same
+    void seedEffects(uint32_t seed) {
+        explosion.emitter.random.reseed(seed);
+        sparks.emitter.random.reseed(seed ^ 0x5BD1E995u);
+    }
 
-    LevelGameState(int level = 0)
-        : playerDirection(PlayerDirection::IN)
+    LevelGameState(AudioSink& audio, NoLevel)
+        : GameState(audio)
+        , playerDirection(PlayerDirection::IN)
         , simTick(0)
         , debugText(WHITE, {30, 30})
         , pausedText(WHITE, { 370, 300 }, "PAUSED")
@@ -1095,32 +2320,26 @@ public:
         , desiredPlayerVerticalSpeed(playerVerticalSpeed)
 
     {
-        //lg.loadLevelFromImage("Content/test_level.png");
-        if (level == 0) {
-            lg.generateLevel();
-        }
-        else if (level == 1) {
-            lg.generateLevel2();
-        }
-        else {
-            lg.generateLevel3();
-        }
         lg.loadBackgroundImage("Content/test_level_bg.png");
 
         debugText.display = false;
         pausedText.display = false;
     }
 
+public:
+
     ~LevelGameState()
     {
     }
 
-    void Sim(float simTimeSeconds) override {
-        gSimTick = simTick;
+    void Sim(float simTimeSeconds, const InputFrame& input) override {
+        PROFILE_SCOPE("Sim");
+        lg.animTick = simTick;
 
-        if (IsKeyPressed(KEY_K)) noKill = !noKill;
-        if (IsKeyPressed(KEY_ZERO)) debugText.display = !debugText.display;
-        if (IsKeyPressed(KEY_P)) {
+        if (input.hit(BUTTON_NO_KILL)) noKill = !noKill;
+        if (input.hit(BUTTON_DEBUG)) debugText.display = !debugText.display;
+        if (input.hit(BUTTON_SERIAL_JOBS)) jobSystem().serial = !jobSystem().serial; // compare against the single threaded path
+        if (input.hit(BUTTON_PAUSE)) {
             paused = !paused;
             pausedText.display = paused;
         }
@@ -1137,97 +2356,20 @@ public:
             finalCountdown = 60 * 5; // 5 seconds
         }
 
+        sparks.simit();
         if (playerDead) {
             explosion.simit(simTick);
             return;
         }
 
-        auto setPlayerDir = [=](PlayerDirection dir) {
-            const float verticalSpeedContiniousScale = 0.5f;
-                playerDirection = dir;
-            if (dir == PlayerDirection::IN)
-                desiredPlayerVerticalSpeed = playerVerticalSpeed * verticalSpeedContiniousScale;
-            else if (dir == PlayerDirection::OUT)
-                desiredPlayerVerticalSpeed = -playerVerticalSpeed * verticalSpeedContiniousScale;
-            else if (dir == PlayerDirection::CCW)
-                desiredPlayerHorizontalSpeed = -playerHorizontalSpeed;
-            else if (dir == PlayerDirection::CW)
-                desiredPlayerHorizontalSpeed = playerHorizontalSpeed;
-            else
-                desiredPlayerHorizontalSpeed = desiredPlayerVerticalSpeed = 0;;
-        };
- 
-        if (classicControls) {
-            if (IsKeyDown(KEY_UP) || IsKeyDown(KEY_W)) setPlayerDir(PlayerDirection::IN);
-            if (IsKeyDown(KEY_DOWN) || IsKeyDown(KEY_S)) setPlayerDir(PlayerDirection::OUT);
-            if (IsKeyDown(KEY_LEFT) || IsKeyDown(KEY_A)) setPlayerDir(PlayerDirection::CCW);
-            if (IsKeyDown(KEY_RIGHT) || IsKeyDown(KEY_D)) setPlayerDir(PlayerDirection::CW);
-        }
-        else {
-            if (lg.playerPosition < lg.sliceWidth) {
-                if (IsKeyDown(KEY_UP) || IsKeyDown(KEY_W)) setPlayerDir(PlayerDirection::OUT);
-                if (IsKeyDown(KEY_DOWN) || IsKeyDown(KEY_S)) setPlayerDir(PlayerDirection::IN);
-                if (IsKeyDown(KEY_LEFT) || IsKeyDown(KEY_A)) setPlayerDir(PlayerDirection::CCW);
-                if (IsKeyDown(KEY_RIGHT) || IsKeyDown(KEY_D)) setPlayerDir(PlayerDirection::CW);
-            }
-            else if (lg.playerPosition < lg.sliceWidth + lg.sliceHeight) {
-                if (IsKeyDown(KEY_UP) || IsKeyDown(KEY_W)) setPlayerDir(PlayerDirection::CCW);
-                if (IsKeyDown(KEY_DOWN) || IsKeyDown(KEY_S)) setPlayerDir(PlayerDirection::CW);
-                if (IsKeyDown(KEY_LEFT) || IsKeyDown(KEY_A)) setPlayerDir(PlayerDirection::IN);
-                if (IsKeyDown(KEY_RIGHT) || IsKeyDown(KEY_D)) setPlayerDir(PlayerDirection::OUT);
-            }
-            else if (lg.playerPosition < 2*lg.sliceWidth + lg.sliceHeight) {
-                if (IsKeyDown(KEY_UP) || IsKeyDown(KEY_W)) setPlayerDir(PlayerDirection::IN);
-                if (IsKeyDown(KEY_DOWN) || IsKeyDown(KEY_S)) setPlayerDir(PlayerDirection::OUT);
-                if (IsKeyDown(KEY_LEFT) || IsKeyDown(KEY_A)) setPlayerDir(PlayerDirection::CW);
-                if (IsKeyDown(KEY_RIGHT) || IsKeyDown(KEY_D)) setPlayerDir(PlayerDirection::CCW);
-            }
-            else {
-                if (IsKeyDown(KEY_UP) || IsKeyDown(KEY_W)) setPlayerDir(PlayerDirection::CW);
-                if (IsKeyDown(KEY_DOWN) || IsKeyDown(KEY_S)) setPlayerDir(PlayerDirection::CCW);
-                if (IsKeyDown(KEY_LEFT) || IsKeyDown(KEY_A)) setPlayerDir(PlayerDirection::OUT);
-                if (IsKeyDown(KEY_RIGHT) || IsKeyDown(KEY_D)) setPlayerDir(PlayerDirection::IN);
-            }
-        }
-
-        if (absoluteControls) {
-            bool wasCollision = false;
-            if (playerDirection == PlayerDirection::IN) {
-                wasCollision = lg.incrPlayerSlice(playerVerticalSpeed);
-            }
-            else if (playerDirection == PlayerDirection::OUT) {
-                wasCollision = lg.incrPlayerSlice(-playerVerticalSpeed);
-            }
-            else if (playerDirection == PlayerDirection::CCW) {
-                wasCollision = lg.incrPlayerPosition(-playerHorizontalSpeed);
-            }
-            else if (playerDirection == PlayerDirection::CW) {
-                wasCollision = lg.incrPlayerPosition(playerHorizontalSpeed);
-            }
-
-            if (wasCollision) {
-                PlaySound(bump);
-                playerDirection = PlayerDirection::NONE;
-            }
-        }
-        else {
-            float vDelta = desiredPlayerVerticalSpeed - currPlayerVerticalSpeed;
-            currPlayerVerticalSpeed = currPlayerVerticalSpeed + std::max(-playerVerticalSpeed * .33f, std::min(playerVerticalSpeed * .33f, vDelta));
-            currPlayerVerticalSpeed = std::max(-playerVerticalSpeed, std::min(playerVerticalSpeed, currPlayerVerticalSpeed));
-            float hDelta = desiredPlayerHorizontalSpeed - currPlayerHorizontalSpeed;
-            currPlayerHorizontalSpeed = currPlayerHorizontalSpeed + std::max(-playerHorizontalSpeed * .33f, std::min(playerHorizontalSpeed * .33f, hDelta));
-            currPlayerHorizontalSpeed = std::max(-playerHorizontalSpeed, std::min(playerHorizontalSpeed, currPlayerHorizontalSpeed));
-
-            if (lg.incrPlayerSlice(currPlayerVerticalSpeed))
-            {
-                //currPlayerVerticalSpeed = desiredPlayerVerticalSpeed = 0.0f;
-            }
-
-            if (lg.incrPlayerPosition(currPlayerHorizontalSpeed))
-            {
-                //currPlayerHorizontalSpeed = desiredPlayerHorizontalSpeed = 0.0f;
-            }
+        PlayerMotion motion = playerMotion();
+        SimSpacePosition collision;
+        if (stepPlayer(lg, controlFlags(), lg.solidPhasesAt(simTick), input, motion, collision)) {
+            if (absoluteControls)
+                audio.play(GameSound::Bump);
+            sparks.scrape(collision, simTick); // once, even if both axes hit
         }
+        setPlayerMotion(motion);
 
         if (simTick % 12 == 0) {
             lg.dangerZone++;
@@ -1236,52 +2378,185 @@ public:
         float dangerValue = lg.dangerZoneT();
         //std::cout << GetMusicTimePlayed(dangerSound) << std::endl;
         if (dangerValue < 0.01f) {
-            if (IsSoundPlaying(dangerSound))
-                StopSound(dangerSound);
-            SetSoundVolume(dangerSound, 0.0f);
+            if (audio.isPlaying(GameSound::Danger))
+                audio.stop(GameSound::Danger);
+            audio.setVolume(GameSound::Danger, 0.0f);
         }
         else {
-            if (! IsSoundPlaying(dangerSound))
-                PlaySound(dangerSound);
-            SetSoundVolume(dangerSound, dangerValue * 0.4f);
+            if (! audio.isPlaying(GameSound::Danger))
+                audio.play(GameSound::Danger);
+            audio.setVolume(GameSound::Danger, dangerValue * 0.4f);
         }
 
         if (!noKill && static_cast<int>(floorf(lg.playerSlice)) <= lg.dangerZone) {
             playerDead = true;
-            explosion.origin = SimSpacePosition(lg.playerSlice, lg.playerPosition);
-            PlaySound(deathSound);
+            explosion.start(SimSpacePosition(lg.playerSlice, lg.playerPosition));
+            audio.play(GameSound::Death);
         }
 
         if (!gameWon && lg.playerSlice > lg.winningZone) {
             gameWon = true;
-            PlaySound(winSound);
+            audio.play(GameSound::Win);
         }
 
-        std::stringstream ss;
-        ss << "Sim tick " << simTick << ", Player: (" << lg.playerSlice << ", " << lg.playerPosition << ")";
-        debugText.text = ss.str();
         simTick++;
     }
 
+    // Everything Sim changes after the level is generated; see Replay.h. The level itself is not
+    // part of it, it is rebuilt from level number and seed.
+    template<typename Visitor>
+    void visitState(Visitor& visit) {
+        visitGameplayState(visit);
+        visitEffectsState(visit);
+    }
+
+    // The small part of the state, including where and when effects were last triggered, so that
+    // stepEffects() can follow along; the rewind buffer stores it every tick.
+    template<typename Visitor>
+    void visitGameplayState(Visitor& visit) {
+        visit(simTick);
+        visit(finished);
+        visit(playerDirection);
+        visit(paused);
+        visit(playerDead);
+        visit(noKill);
+        visit(gameWon);
+        visit(finalCountdown);
+        visit(debugText.display);
+        visit(currPlayerHorizontalSpeed);
+        visit(currPlayerVerticalSpeed);
+        visit(desiredPlayerHorizontalSpeed);
+        visit(desiredPlayerVerticalSpeed);
+        visit(lg.playerSlice);
+        visit(lg.playerPosition);
+        visit(lg.dangerZone);
+        visit(lg.animTick);
+        visit(explosion.origin.slice);
+        visit(explosion.origin.positionInSlice);
+        visit(sparks.lastBurstTick);
+        visit(sparks.emitter.originX);
+        visit(sparks.emitter.originY);
+        pausedText.display = paused;
+    }
+
+    // particle effects, large and cosmetic
+    template<typename Visitor>
+    void visitEffectsState(Visitor& visit) {
+        explosion.particles.visitState(visit);
+        explosion.emitter.visitState(visit);
+        sparks.particles.visitState(visit);
+        sparks.emitter.visitState(visit);
+    }
+
+    // What stepEffects() needs from the gameplay state before a tick.
+    typedef struct EffectsCue {
+        bool playerDead;
+        int lastBurstTick;
+    } EffectsCue;
+
+    EffectsCue effectsCue() const { return EffectsCue{ playerDead, sparks.lastBurstTick }; }
+
+    // Runs the effects through one tick exactly as Sim does, with the gameplay state after the tick
+    // already in place; the rewind buffer uses it to rebuild effects between snapshots.
+    void stepEffects(const EffectsCue& before) {
+        if (paused)
+            return;
+        sparks.simit();
+        if (before.playerDead) {
+            explosion.simit(simTick);
+            return;
+        }
+        if (sparks.lastBurstTick != before.lastBurstTick)
+            sparks.burst();
+        if (playerDead)
+            explosion.start(explosion.origin);
+    }
+
+    // the control scheme picked on the title screen, for replays
+    // where the player is drawn, which SimThread interpolates between ticks
+    typedef struct Pose {
+        float slice;
+        float position;
+    } Pose;
+
+    Pose pose() const { return Pose{ lg.playerSlice, lg.playerPosition }; }
+
+    void setPose(const Pose& pose) {
+        lg.playerSlice = pose.slice;
+        lg.playerPosition = pose.position;
+    }
+
+    // the short way round the slice, which the position wraps around
+    Pose interpolatePose(const Pose& from, const Pose& to, float t) const {
+        const float perimeter = static_cast<float>(2 * lg.sliceWidth + 2 * lg.sliceHeight);
+        float delta = to.position - from.position;
+        if (delta > perimeter / 2)
+            delta -= perimeter;
+        else if (delta < -perimeter / 2)
+            delta += perimeter;
+        return Pose{ from.slice + (to.slice - from.slice) * t, fmodf(from.position + delta * t + perimeter, perimeter) };
+    }
+
+    PlayerMotion playerMotion() const {
+        PlayerMotion motion(lg.playerSlice, lg.playerPosition);
+        motion.direction = playerDirection;
+        motion.currHorizontalSpeed = currPlayerHorizontalSpeed;
+        motion.currVerticalSpeed = currPlayerVerticalSpeed;
+        motion.desiredHorizontalSpeed = desiredPlayerHorizontalSpeed;
+        motion.desiredVerticalSpeed = desiredPlayerVerticalSpeed;
+        return motion;
+    }
+
+    void setPlayerMotion(const PlayerMotion& motion) {
+        lg.playerSlice = motion.slice;
+        lg.playerPosition = motion.position;
+        playerDirection = motion.direction;
+        currPlayerHorizontalSpeed = motion.currHorizontalSpeed;
+        currPlayerVerticalSpeed = motion.currVerticalSpeed;
+        desiredPlayerHorizontalSpeed = motion.desiredHorizontalSpeed;
+        desiredPlayerVerticalSpeed = motion.desiredVerticalSpeed;
+    }
+
+    static uint32_t controlFlags() { return (classicControls ? 1u : 0u) | (absoluteControls ? 2u : 0u); }
+    static void setControlFlags(uint32_t flags) {
+        classicControls = (flags & 1u) != 0;
+        absoluteControls = (flags & 2u) != 0;
+    }
+
     void Render() override {
-        const float centerX = static_cast<float>(GetScreenWidth() / 2);
-        const float centerY = static_cast<float>(GetScreenHeight() / 2);
+        PROFILE_SCOPE("Render");
+        const float centerX = static_cast<float>(canvas().width() / 2);
+        const float centerY = static_cast<float>(canvas().height() / 2);
         transformer.screenCenter = Vector2{ centerX, centerY };
         transformer.slicesPerScreen = lg.slicesPerScreen;
         transformer.sliceAtCenter = lg.playerSlice + lg.slicesBeforePlayer;
 
         lg.transformer = transformer;
         explosion.transform = transformer;
+        sparks.transform = transformer;
 
-        BeginDrawing();
-        ClearBackground(BLACK);
+        if (debugText.display) {
+            TextBuilder builder;
+            builder.append("Sim tick ").append(simTick).append(", Player: (")
+                .append(lg.playerSlice, 3).append(", ").append(lg.playerPosition, 3).append(")")
+                .append(", heap allocs/frame ").append(gFrameAllocations);
+            debugText.setText(builder.c_str());
+        }
 
+        canvas().begin();
+        canvas().beginScene();
+        canvas().clear(BLACK);
         lg.render();
+        sparks.render();
+        if (playerDead) explosion.render();
+        canvas().endScene();
+
         debugText.render();
         pausedText.render();
-        if (playerDead) explosion.render();
+        drawProfileOverlay();
+        drawMemoryOverlay();
 
-        EndDrawing();
+        canvas().end();
     }
 
     int simTick;
@@ -1296,8 +2571,6 @@ public:
     int finalCountdown; // -1 disabled, num sims to final
     static bool classicControls;
     static bool absoluteControls;
-    const float playerHorizontalSpeed = 0.75;
-    const float playerVerticalSpeed = 0.5;
     float currPlayerHorizontalSpeed;
     float currPlayerVerticalSpeed;
     float desiredPlayerHorizontalSpeed;
@@ -1305,6 +2578,7 @@ public:
 
     LevelTransformer transformer;
     Explosion explosion;
+    Sparks sparks;
 };
 
 bool LevelGameState::classicControls = true;
@@ -1315,18 +2589,23 @@ class TitleScreenGameState : public LevelGameState
 public:
     enum class PlayerDirection { CCW, CW, IN, OUT, NONE };
 
-    TitleScreenGameState()
-        : tick(0)
-        , titleText(WHITE, { float(GetScreenWidth()/2), float(GetScreenHeight()/4) }, "Pix'in'", 100)
-        , title2Text(WHITE, { float(GetScreenWidth() / 2), float(GetScreenHeight() / 4 + 120) }, "(Ludum Dare #48)", 20)
-        , instructions(WHITE, { float(GetScreenWidth() / 2), float(GetScreenHeight() - 90) }, "Space to start game. 'k' during game to disable kill wall, 'p' to pause,", 20)
-        , instructions2(WHITE, { float(GetScreenWidth() / 2), float(GetScreenHeight() - 60) }, "left/right/up/down arrows (or A/D/W/S)", 20)
-        , instructions3(WHITE, { float(GetScreenWidth() / 2), float(GetScreenHeight() - 30) }, "for counter-clockwise/clockwise/in/out.", 20)
-        , level1(WHITE, { float(GetScreenWidth() / 2), float(GetScreenHeight() / 2 + 20) }, "Simple Level", 20)
-        , level2(WHITE, { float(GetScreenWidth() / 2), float(GetScreenHeight() / 2 + 45) }, "Rando Maze", 20)
-        , level3(WHITE, { float(GetScreenWidth() / 2), float(GetScreenHeight() / 2 + 70) }, "Rando Maze Hard (takes ~10 seconds)", 20)
-        , controlsText(WHITE, { float(GetScreenWidth() / 2), float(GetScreenHeight() / 2 + 115) }, "", 20)
+    static constexpr float scrollSlicesPerSecond = 30.0f;
+
+    TitleScreenGameState(AudioSink& audio)
+        : LevelGameState(audio)
+        , tick(0)
+        , titleText(WHITE, { float(canvas().width()/2), float(canvas().height()/4) }, "Pix'in'", 100)
+        , title2Text(WHITE, { float(canvas().width() / 2), float(canvas().height() / 4 + 120) }, "(Ludum Dare #48)", 20)
+        , instructions(WHITE, { float(canvas().width() / 2), float(canvas().height() - 90) }, "Space to start. In game 'k' disables the kill wall, 'p' pauses, 'r' rewinds,", 20)
+        , instructions2(WHITE, { float(canvas().width() / 2), float(canvas().height() - 60) }, "left/right/up/down arrows (or A/D/W/S)", 20)
+        , instructions3(WHITE, { float(canvas().width() / 2), float(canvas().height() - 30) }, "for counter-clockwise/clockwise/in/out.", 20)
+        , level1(WHITE, { float(canvas().width() / 2), float(canvas().height() / 2 + 20) }, "Simple Level", 20)
+        , level2(WHITE, { float(canvas().width() / 2), float(canvas().height() / 2 + 45) }, "Rando Maze", 20)
+        , level3(WHITE, { float(canvas().width() / 2), float(canvas().height() / 2 + 70) }, "Rando Maze Hard (takes ~10 seconds)", 20)
+        , controlsText(WHITE, { float(canvas().width() / 2), float(canvas().height() / 2 + 115) }, "", 20)
+        , generatingText(WHITE, { float(canvas().width() / 2), float(canvas().height() / 2 + 150) }, "", 20)
         , currLevel(0)
+        , generated(-1.0f)
     {
         lg.loadBackgroundImage("Content/test_level_bg.png");
     }
@@ -1335,38 +2614,40 @@ public:
     {
     }
 
-    void Sim(float simTimeSeconds) override {
+    void Sim(float simTimeSeconds, const InputFrame& input) override {
+        lg.playerSlice += scrollSlicesPerSecond * simTimeSeconds;
+        ++tick;
+        if (generated >= 0.0f)
+            return;
         if (currLevel < 3) {
-            if (IsKeyPressed(KEY_SPACE) || IsKeyPressed(KEY_ENTER)) {
+            if (input.hit(BUTTON_CONFIRM)) {
                 finished = true;
             }
         }
         else
         {
-            if (IsKeyPressed(KEY_RIGHT) || IsKeyPressed(KEY_D) ||
-                IsKeyPressed(KEY_SPACE) || IsKeyPressed(KEY_ENTER)) {
+            if (input.hit(BUTTON_RIGHT | BUTTON_CONFIRM)) {
                 controlType = (controlType + 1) % 4;
             }
-            else if (IsKeyPressed(KEY_LEFT) || IsKeyPressed(KEY_A)) {
+            else if (input.hit(BUTTON_LEFT)) {
                 controlType = (controlType + 3) % 4;
             }
         }
         classicControls = !(controlType & 0x1);
         absoluteControls = !(controlType & 0x2);
 
-        if (IsKeyPressed(KEY_UP) || IsKeyPressed(KEY_W)) {
+        if (input.hit(BUTTON_UP)) {
             currLevel = (currLevel + 3) % 4;
         }
-        if (IsKeyPressed(KEY_DOWN) || IsKeyPressed(KEY_S)) {
+        if (input.hit(BUTTON_DOWN)) {
             currLevel = (currLevel + 1) % 4;
         }
-        lg.playerSlice += 0.5f;
-        ++tick;
     }
 
     void Render() override {
-        const float centerX = static_cast<float>(GetScreenWidth() / 2);
-        const float centerY = static_cast<float>(GetScreenHeight() / 2);
+        PROFILE_SCOPE("Render");
+        const float centerX = static_cast<float>(canvas().width() / 2);
+        const float centerY = static_cast<float>(canvas().height() / 2);
         transformer.screenCenter = Vector2{ centerX, centerY };
         transformer.slicesPerScreen = lg.slicesPerScreen;
         transformer.sliceAtCenter = lg.playerSlice + lg.slicesBeforePlayer;
@@ -1388,16 +2669,24 @@ public:
             controlsText.color = GREEN;
         }
 
-        controlsText.text = std::string("Controls: ") + std::string(classicControls ? "LudamDare 48 Classic" : "Direct") + std::string(absoluteControls ? "" : " **Experimental Always Move**");
-        instructions3.text = classicControls ? "for counter-clockwise/clockwise/in/out." : "to move in that direction.";
+        static const char* const controlsLabels[4] = {
+            "Controls: Direct **Experimental Always Move**",
+            "Controls: Direct",
+            "Controls: LudamDare 48 Classic **Experimental Always Move**",
+            "Controls: LudamDare 48 Classic",
+        };
+        controlsText.setText(controlsLabels[(classicControls ? 2 : 0) + (absoluteControls ? 1 : 0)]);
+        instructions3.setText(classicControls ? "for counter-clockwise/clockwise/in/out." : "to move in that direction.");
 
 
         lg.transformer = transformer;
         explosion.transform = transformer;
 
-        BeginDrawing();
-        ClearBackground(BLACK);
+        canvas().begin();
+        canvas().beginScene();
+        canvas().clear(BLACK);
         lg.drawBackground();
+        canvas().endScene();
         titleText.render();
         title2Text.render();
         instructions.render();
@@ -1407,7 +2696,13 @@ public:
         level2.render();
         level3.render();
         controlsText.render();
-        EndDrawing();
+        if (generated >= 0.0f) {
+            generatingText.setText("Generating level... " + std::to_string(static_cast<int>(generated * 100.0f)) + "%");
+            generatingText.render();
+        }
+        drawProfileOverlay();
+        drawMemoryOverlay();
+        canvas().end();
     }
 
     int tick;
@@ -1421,59 +2716,998 @@ public:
     Text level1;
     Text level2;
     Text level3;
+    Text generatingText;
     int currLevel;
+    float generated; // how much of the chosen level is generated, from 0 to 1; -1 until one is chosen
 
     static int controlType;
 };
 
 int TitleScreenGameState::controlType = 0;
 
+// Steps many copies of one level side by side, for automated agents. Every environment has its own
+// player, danger zone and tick count, moving through one shared read-only LevelGeometry by the same
+// rules as LevelGameState (stepPlayer) but without effects, sound or rendering. Player state is kept
+// as one array per field, and step() hands out pieces of the environments to the job system. After
+// a step observation(env) holds the level around that player.
+class BatchEnv
+{
+public:
+    enum class Status : unsigned char { Running, Won, Dead };
+
+    // Environments start where the level's player is when the batch is created.
+    BatchEnv(const LevelGeometry& level, int numEnvs, uint32_t controls = 1)
+        : level(level)
+        , controls(controls)
+        , startSlice(level.playerSlice)
+        , startPosition(level.playerPosition)
+        , playerSlice(numEnvs)
+        , playerPosition(numEnvs)
+        , playerDirection(numEnvs)
+        , currHorizontalSpeed(numEnvs)
+        , currVerticalSpeed(numEnvs)
+        , desiredHorizontalSpeed(numEnvs)
+        , desiredVerticalSpeed(numEnvs)
+        , dangerZone(numEnvs)
+        , tick(numEnvs)
+        , status(numEnvs)
+        , collided(numEnvs)
+        , reward(numEnvs)
+        , observations(size_t(numEnvs) * patchSize)
+    {
+        for (int env = 0; env < numEnvs; ++env) {
+            reset(env);
+        }
+    }
+
+    int size() const { return static_cast<int>(tick.size()); }
+
+    void reset(int env) {
+        setMotion(env, PlayerMotion(startSlice, startPosition));
+        dangerZone[env] = LevelGeometry::startingDangerZone;
+        tick[env] = 0;
+        status[env] = Status::Running;
+        collided[env] = 0;
+        reward[env] = 0.0f;
+        observe(env);
+    }
+
+    // Advances every environment one tick; actions[env] are the InputButton bits held in it.
+    void step(const uint32_t* actions) {
+        jobSystem().parallelFor(size(), envsPerJob, [this, actions](int begin, int end) {
+            for (int env = begin; env < end; ++env) {
+                stepEnv(env, actions[env]);
+            }
+        });
+    }
+
+    // patchSlices rows of patchPositions cells, starting patchBehind slices behind the player
+    const unsigned char* observation(int env) const { return &observations[size_t(env) * patchSize]; }
+
+    static const int patchSlices = 16;
+    static const int patchBehind = 4;
+    static const int patchPositions = 16; // centred on the player, wrapping around the slice
+    static const int patchSize = patchSlices * patchPositions;
+    static const unsigned char wallCell = 255;
+    static const unsigned char dangerCell = 128; // at or behind the danger zone
+
+    bool autoReset = true; // finished environments start over on their next step
+    bool noKill = false;
+
+    const LevelGeometry& level;
+    const uint32_t controls; // LevelGameState::controlFlags()
+    const float startSlice;
+    const float startPosition;
+
+    // per environment
+    std::vector<float> playerSlice;
+    std::vector<float> playerPosition;
+    std::vector<PlayerDirection> playerDirection;
+    std::vector<float> currHorizontalSpeed;
+    std::vector<float> currVerticalSpeed;
+    std::vector<float> desiredHorizontalSpeed;
+    std::vector<float> desiredVerticalSpeed;
+    std::vector<int> dangerZone;
+    std::vector<int> tick;
+    std::vector<Status> status;
+    std::vector<unsigned char> collided; // ran into a wall last step
+    std::vector<float> reward;           // slices gained last step
+
+private:
+    static const int envsPerJob = 256;
+
+    PlayerMotion motion(int env) const {
+        PlayerMotion motion(playerSlice[env], playerPosition[env]);
+        motion.direction = playerDirection[env];
+        motion.currHorizontalSpeed = currHorizontalSpeed[env];
+        motion.currVerticalSpeed = currVerticalSpeed[env];
+        motion.desiredHorizontalSpeed = desiredHorizontalSpeed[env];
+        motion.desiredVerticalSpeed = desiredVerticalSpeed[env];
+        return motion;
+    }
+
+    void setMotion(int env, const PlayerMotion& motion) {
+        playerSlice[env] = motion.slice;
+        playerPosition[env] = motion.position;
+        playerDirection[env] = motion.direction;
+        currHorizontalSpeed[env] = motion.currHorizontalSpeed;
+        currVerticalSpeed[env] = motion.currVerticalSpeed;
+        desiredHorizontalSpeed[env] = motion.desiredHorizontalSpeed;
+        desiredVerticalSpeed[env] = motion.desiredVerticalSpeed;
+    }
+
+    // the gameplay half of LevelGameState::Sim
+    void stepEnv(int env, uint32_t action) {
+        if (status[env] != Status::Running) {
+            if (!autoReset)
+                return;
+            reset(env);
+        }
+        PlayerMotion next = motion(env);
+        SimSpacePosition collision;
+        collided[env] = stepPlayer(level, controls, level.solidPhasesAt(tick[env]), InputFrame{ action, 0 }, next, collision) ? 1 : 0;
+        reward[env] = next.slice - playerSlice[env];
+        setMotion(env, next);
+
+        if (tick[env] % 12 == 0) {
+            dangerZone[env]++;
+        }
+        if (!noKill && static_cast<int>(floorf(next.slice)) <= dangerZone[env]) {
+            status[env] = Status::Dead;
+        }
+        else if (next.slice > level.winningZone) {
+            status[env] = Status::Won;
+        }
+        tick[env]++;
+        observe(env);
+    }
+
+    void observe(int env) {
+        unsigned char* out = &observations[size_t(env) * patchSize];
+        const int sliceSize = level.sliceSize;
+        const int numSlices = static_cast<int>(level.shape->geom.size());
+        const int firstSlice = static_cast<int>(floorf(playerSlice[env])) - patchBehind;
+        const int firstPosition = static_cast<int>(floorf(playerPosition[env])) - patchPositions / 2 + sliceSize;
+        const uint32_t solidPhases = level.solidPhasesAt(tick[env]);
+        for (int row = 0; row < patchSlices; ++row, out += patchPositions) {
+            const int slice = firstSlice + row;
+            if (slice <= dangerZone[env]) {
+                memset(out, dangerCell, patchPositions);
+            }
+            else if (slice < 0 || slice >= numSlices) {
+                memset(out, 0, patchPositions);
+            }
+            else {
+                const unsigned char* cells = level.shape->geom[slice].data();
+                for (int col = 0; col < patchPositions; ++col) {
+                    out[col] = LevelGeometry::cellSolid(cells[(firstPosition + col) % sliceSize], solidPhases) ? wallCell : 0;
+                }
+            }
+        }
+    }
+
+    std::vector<unsigned char> observations;
+};
+
+// Breadth-first distances over rows [0, goalRow] of a grid wrapped into a cylinder, columns around,
+// from every open cell of goalRow. Each cell's neighbours are the cells beside it in its row, which
+// wrap, and the cells above and below it. Cells with no way to goalRow get LevelAnalysis::unreachable.
+template<typename Open, typename Distances>
+void cylinderDistances(int goalRow, int columns, const Open& open, Distances& distances)
+{
+    const int unreachable = -1;
+    const size_t numCells = size_t(goalRow + 1) * columns;
+    distances.assign(numCells, unreachable);
+    ArenaScope scope(generationArena());
+    ArenaVector<int> queue(generationArena());
+    queue.reserve(numCells); // cells are marked when queued, so each is queued at most once
+
+    auto visit = [&](int row, int column, int distance) {
+        const int cell = row * columns + column;
+        if (distances[cell] != unreachable || !open(row, column))
+            return;
+        distances[cell] = distance;
+        queue.push_back(cell);
+    };
+    for (int column = 0; column < columns; ++column) {
+        visit(goalRow, column, 0);
+    }
+    for (size_t next = 0; next < queue.size(); ++next) {
+        const int cell = queue[next];
+        const int row = cell / columns;
+        const int column = cell % columns;
+        const int distance = distances[cell] + 1;
+        visit(row, (column + 1) % columns, distance);
+        visit(row, (column + columns - 1) % columns, distance);
+        if (row > 0)
+            visit(row - 1, column, distance);
+        if (row < goalRow)
+            visit(row + 1, column, distance);
+    }
+}
+
+// How far every place the player can stand in a level is from the goal, and what that says about
+// the route: whether the player fits through at all, how long the shortest way is and where it
+// narrows.
+//
+// This is for the default player, a 1x1 box, whose footprint always overlaps two slices and two
+// positions; a gap one cell wide is a way through for the maze generators but not for the player.
+// Places are named by the cells the box overlaps: row r covers slices r and r + 1 (a player slice in
+// [r + 0.5, r + 1.5)) and column c positions c - 1 and c (a position in [c - 0.5, c + 0.5)), round
+// the seam for column 0.
+//
+// Edits to the level are not patched into the distances: a wall added or taken away anywhere can
+// change the way from every place behind it. refresh() analyses the level again if it has changed
+// since, and current() says whether it has. A level is known by its levelId rather than its address,
+// which a later level may be given.
+class LevelAnalysis
+{
+public:
+    enum class Verdict { Traversable, TooNarrow, Blocked };
+
+    static const int unreachable = -1;
+    static const int chokeWidth = 24; // rows that lead on through this many places or fewer, under a tenth of the way round
+
+    LevelAnalysis()
+        : verdict(Verdict::Blocked)
+        , pathLength(unreachable)
+        , chokepoints(0)
+        , narrowest(0)
+        , goalRow(0)
+        , columns(0)
+        , analysedLevel(0)
+        , analysedVersion(0)
+    {
+    }
+
+    bool current(const LevelGeometry& level) const {
+        return analysedLevel == level.levelId && analysedVersion == level.geometryVersion && !level.editsPending();
+    }
+
+    // analyse() again if the level has changed since; its edits must have been applied
+    void refresh(const LevelGeometry& level) {
+        if (!current(level))
+            analyse(level);
+    }
+
+    void analyse(const LevelGeometry& level) {
+        PROFILE_SCOPE("LevelAnalysis::analyse");
+        analysedLevel = level.levelId;
+        analysedVersion = level.geometryVersion;
+        const int sliceSize = level.sliceSize;
+        const int numSlices = static_cast<int>(level.shape->geom.size());
+        goalRow = std::max(0, std::min(level.winningZone, numSlices - 2));
+        columns = sliceSize;
+        const int startRow = rowOf(level.playerSlice);
+        const int startColumn = columnOf(level.playerPosition);
+
+        // walls of a phase group open again sooner or later, so only the others are in the way
+        auto open = [&](int slice, int position) { return level.shape->geom[slice][position] != LevelGeometry::solidCell; };
+        cylinderDistances(goalRow, columns, [&](int row, int column) {
+            const int before = (column + sliceSize - 1) % sliceSize;
+            return open(row, before) && open(row, column) && open(row + 1, before) && open(row + 1, column);
+        }, distances);
+        pathLength = distances[size_t(startRow) * columns + startColumn];
+
+        // a single point, which is all the generators check for
+        bool pointPath = pathLength != unreachable;
+        if (!pointPath) {
+            ArenaScope scope(generationArena());
+            ArenaVector<int> pointDistances(generationArena());
+            cylinderDistances(goalRow + 1, sliceSize, open, pointDistances);
+            const int startSlice = std::max(0, std::min(static_cast<int>(floorf(level.playerSlice)), goalRow + 1));
+            const int startPosition = static_cast<int>(floorf(level.playerPosition)) % sliceSize;
+            pointPath = pointDistances[size_t(startSlice) * sliceSize + startPosition] != unreachable;
+        }
+        verdict = pathLength != unreachable ? Verdict::Traversable : pointPath ? Verdict::TooNarrow : Verdict::Blocked;
+
+        // the rows between start and goal by how many places in them can reach the goal
+        chokepoints = 0;
+        narrowest = columns;
+        bool inChoke = false;
+        for (int row = startRow; row <= goalRow; ++row) {
+            const int* rowDistances = &distances[size_t(row) * columns];
+            const int width = static_cast<int>(std::count_if(rowDistances, rowDistances + columns, [](int distance) { return distance != unreachable; }));
+            narrowest = std::min(narrowest, width);
+            const bool choke = width <= chokeWidth;
+            chokepoints += choke && !inChoke;
+            inChoke = choke;
+        }
+    }
+
+    // Steps from the place a player at (slice, position) stands to the goal; 0 past it.
+    int distanceAt(float slice, float position) const {
+        if (slice >= static_cast<float>(goalRow) + 0.5f)
+            return 0;
+        return distances[size_t(rowOf(slice)) * columns + columnOf(position)];
+    }
+
+    // Where to head from (slice, position) to get one step closer to the goal: the middle of the next
+    // place along a shortest way, or (slice, position) itself if there is none.
+    SimSpacePosition towardGoal(float slice, float position) const {
+        const int distance = distanceAt(slice, position);
+        if (distance == unreachable || distance == 0)
+            return SimSpacePosition(slice, position);
+        const int row = rowOf(slice);
+        const int column = columnOf(position);
+        const int candidates[4][2] = { { row + 1, column }, { row, (column + 1) % columns }, { row, (column + columns - 1) % columns }, { row - 1, column } };
+        for (const auto& candidate : candidates) {
+            if (candidate[0] < 0 || candidate[0] > goalRow)
+                continue;
+            if (distances[size_t(candidate[0]) * columns + candidate[1]] == distance - 1)
+                return SimSpacePosition(static_cast<float>(candidate[0]) + 1.0f, static_cast<float>(candidate[1]));
+        }
+        return SimSpacePosition(slice, position);
+    }
+
+    Verdict verdict;
+    int pathLength;        // steps from where the level starts the player to the goal, or unreachable
+    int chokepoints;       // runs of rows crossed at chokeWidth places or fewer
+    int narrowest;         // fewest places in any row between start and goal that lead to it
+    std::vector<int> distances; // steps to the goal, goalRow + 1 rows of columns places
+
+private:
+    int rowOf(float slice) const {
+        return std::max(0, std::min(static_cast<int>(floorf(slice - 0.5f)), goalRow));
+    }
+    int columnOf(float position) const {
+        return (static_cast<int>(floorf(position + 0.5f)) % columns + columns) % columns;
+    }
+
+    int goalRow;           // where the player has won
+    int columns;
+    unsigned analysedLevel;   // the levelId of the level analysed, 0 for none
+    unsigned analysedVersion; // its geometryVersion then
+};
+
+// One tick of a level. While rewind is held the game steps back through its history instead,
+// and the replay forgets the ticks undone so it still plays back to the same state.
+void stepLevel(LevelGameState& game, float simTimeSeconds, const InputFrame& input,
+    RewindBuffer<LevelGameState>& rewind, ReplayRecorder<LevelGameState>* recorder)
+{
+    const int rewindTicksPerFrame = 2;
+    if (input.down(BUTTON_REWIND)) {
+        const int tick = rewind.rewindTo(rewind.newestTick() - rewindTicksPerFrame);
+        if (recorder)
+            recorder->truncate(tick);
+        return;
+    }
+    game.Sim(simTimeSeconds, input);
+    if (recorder)
+        recorder->record(input);
+    rewind.record();
+}
+
+// The FrameStats section a level's frames count toward: the level itself, or how it ended.
+const char* levelSection(const LevelGameState& game, int level, char (&name)[24])
+{
+    if (game.gameWon)
+        return "win";
+    if (game.playerDead)
+        return "death";
+    snprintf(name, sizeof(name), "level %d", level);
+    return name;
+}
+
+int64_t microsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+const int screenWidth = 800;
+const int screenHeight = 600;
+
+typedef struct HeadlessOptions {
+    int level = 0;
+    uint32_t seed = 1;
+    uint32_t controls = 1;          // LevelGameState::controlFlags(), classic relative by default
+    int maxTicks = 60 * 60 * 10;
+    const char* inputFile = nullptr;
+    const char* recordFile = nullptr;
+    bool noKill = false;
+    int batch = 0;                  // environments to step side by side in runBatch()
+    const char* screenshotFile = nullptr; // last tick drawn by SoftwareCanvas, as an image
+    bool title = false;             // run the title screen instead of a level
+    int validate = 0;               // seeds to generate and check in runValidate()
+} HeadlessOptions;
+
+bool saveScreenshot(GameState& gameState, SoftwareCanvas& screen, const char* path)
+{
+    std::string error;
+    gameState.Render();
+    if (!screen.save(path, error)) {
+        std::cerr << error << std::endl;
+        return false;
+    }
+    std::cout << path << ": " << screen.trianglesDrawn() << " triangles, " << screen.linesDrawn() << " lines" << std::endl;
+    return true;
+}
+
+// Steps the title screen for maxTicks ticks and draws it, for a screenshot of it.
+int runTitle(const HeadlessOptions& options, ScriptedInput& input, SoftwareCanvas& screen)
+{
+    NullAudio audio;
+    TitleScreenGameState title(audio);
+    int ticks = 0;
+    for (; ticks < options.maxTicks && !title.finished; ++ticks) {
+        frameArena().reset();
+        title.Sim(1.0f / 60.0f, input.next());
+    }
+    std::cout << "title: " << ticks << " ticks" << std::endl;
+    frameArena().reset();
+    return options.screenshotFile && !saveScreenshot(title, screen, options.screenshotFile) ? 1 : 0;
+}
+
+// Runs one level without a window or audio device as fast as the CPU allows, for soak tests and for
+// measuring simulation speed. Stops when the level finishes (five seconds after a win or death) or
+// after maxTicks. Input comes from a script file (see ScriptedInput) or holds "up" by default.
+// Whatever is drawn goes to a SoftwareCanvas, which saves the last tick with screenshotFile.
+int runHeadless(const HeadlessOptions& options)
+{
+    SoftwareCanvas screen(screenWidth, screenHeight);
+    CanvasScope useScreen(screen);
+    ScriptedInput input;
+    if (options.inputFile) {
+        std::string error;
+        if (!input.load(options.inputFile, error)) {
+            std::cerr << options.inputFile << ": " << error << std::endl;
+            return 1;
+        }
+    }
+    else {
+        input.add(options.maxTicks, BUTTON_UP);
+    }
+    if (options.title)
+        return runTitle(options, input, screen);
+
+    NullAudio audio;
+    const float simTimeSeconds = 1.0f / 60.0f;
+    LevelGameState::setControlFlags(options.controls);
+    const auto generateStart = std::chrono::steady_clock::now();
+    LevelGameState gameState(audio, options.level, options.seed);
+    gameState.noKill = options.noKill;
+
+    Replay replay;
+    replay.level = options.level;
+    replay.seed = options.seed;
+    replay.controls = options.controls;
+    std::unique_ptr< ReplayRecorder<LevelGameState> > recorder;
+    if (options.recordFile)
+        recorder.reset(new ReplayRecorder<LevelGameState>(gameState, replay));
+    RewindBuffer<LevelGameState> rewind(gameState);
+
+    const auto simStart = std::chrono::steady_clock::now();
+    int ticks = 0;
+    for (; ticks < options.maxTicks && !gameState.finished; ++ticks) {
+        frameArena().reset();
+        stepLevel(gameState, simTimeSeconds, input.next(), rewind, recorder.get());
+    }
+    const auto simEnd = std::chrono::steady_clock::now();
+
+    const double generateMs = std::chrono::duration<double, std::milli>(simStart - generateStart).count();
+    const double simMs = std::chrono::duration<double, std::milli>(simEnd - simStart).count();
+    const char* outcome = gameState.gameWon ? "won" : (gameState.playerDead ? "dead" : "running");
+    std::cout << "level " << options.level << ": generated in " << generateMs << " ms, "
+        << ticks << " ticks in " << simMs << " ms (" << static_cast<long long>(simMs > 0.0 ? ticks * 1000.0 / simMs : 0.0) << " ticks/s), "
+        << outcome << " at slice " << gameState.lg.playerSlice << ", rewind history of "
+        << rewind.newestTick() - rewind.oldestTick() << " ticks in " << rewind.bytesUsed() / 1024 << " KB" << std::endl;
+
+    if (options.recordFile) {
+        std::string error;
+        if (!replay.save(options.recordFile, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+    if (options.screenshotFile) {
+        frameArena().reset();
+        if (!saveScreenshot(gameState, screen, options.screenshotFile))
+            return 1;
+    }
+    return 0;
+}
+
+// Steps a BatchEnv of options.batch environments for maxTicks ticks with random actions, each held
+// for half a second, and reports the aggregate speed. Input and record files do not apply.
+int runBatch(const HeadlessOptions& options)
+{
+    const auto generateStart = std::chrono::steady_clock::now();
+    LevelGeometry level;
+    level.generate(options.level, options.seed);
+    BatchEnv batch(level, options.batch, options.controls);
+    batch.noKill = options.noKill;
+
+    const uint32_t choices[] = { BUTTON_UP, BUTTON_UP, BUTTON_UP | BUTTON_LEFT, BUTTON_UP | BUTTON_RIGHT, BUTTON_LEFT, BUTTON_RIGHT, BUTTON_DOWN };
+    const int numChoices = sizeof(choices) / sizeof(choices[0]);
+    std::vector<uint32_t> actions(options.batch);
+    Random random(options.seed);
+    long long won = 0;
+    long long died = 0;
+
+    const auto simStart = std::chrono::steady_clock::now();
+    for (int ticks = 0; ticks < options.maxTicks; ++ticks) {
+        if (ticks % 30 == 0) {
+            for (uint32_t& action : actions) {
+                action = choices[random.rangeInt(0, numChoices - 1)];
+            }
+        }
+        batch.step(actions.data());
+        for (int env = 0; env < batch.size(); ++env) {
+            won += batch.status[env] == BatchEnv::Status::Won;
+            died += batch.status[env] == BatchEnv::Status::Dead;
+        }
+    }
+    const auto simEnd = std::chrono::steady_clock::now();
+
+    const double generateMs = std::chrono::duration<double, std::milli>(simStart - generateStart).count();
+    const double simMs = std::chrono::duration<double, std::milli>(simEnd - simStart).count();
+    const double steps = double(options.batch) * options.maxTicks;
+    std::cout << "level " << options.level << ": generated in " << generateMs << " ms, " << options.batch << " environments x "
+        << options.maxTicks << " ticks in " << simMs << " ms (" << static_cast<long long>(simMs > 0.0 ? steps * 1000.0 / simMs : 0.0)
+        << " steps/s on " << jobSystem().numThreads() << " threads), " << won << " won, " << died << " died" << std::endl;
+    return 0;
+}
+
+// Generates options.validate levels from consecutive seeds, starting at options.seed, across the job
+// system and runs a LevelAnalysis of each. Prints the levels the player cannot finish and a summary;
+// returns 2 if there were any. Generating the levels is most of the time, most of all level 2, whose
+// long mazes keep havePath() busy; the bench's generateLevel benchmarks time one of each, and the
+// summary line gives the rate of the run itself.
+int runValidate(const HeadlessOptions& options)
+{
+    typedef struct Result {
+        LevelAnalysis::Verdict verdict;
+        int pathLength;
+        int chokepoints;
+        int narrowest;
+    } Result;
+    std::vector<Result> results(options.validate);
+
+    const auto start = std::chrono::steady_clock::now();
+    jobSystem().parallelFor(options.validate, 1, [&](int begin, int end) {
+        for (int ii = begin; ii < end; ++ii) {
+            LevelGeometry level;
+            level.generate(options.level, options.seed + static_cast<uint32_t>(ii));
+            LevelAnalysis analysis;
+            analysis.analyse(level);
+            results[ii] = Result{ analysis.verdict, analysis.pathLength, analysis.chokepoints, analysis.narrowest };
+        }
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    int tooNarrow = 0;
+    int blocked = 0;
+    long long chokepoints = 0;
+    std::vector<int> pathLengths;
+    for (int ii = 0; ii < options.validate; ++ii) {
+        const Result& result = results[ii];
+        const uint32_t seed = options.seed + static_cast<uint32_t>(ii);
+        chokepoints += result.chokepoints;
+        if (result.verdict == LevelAnalysis::Verdict::Traversable) {
+            pathLengths.push_back(result.pathLength);
+        }
+        else if (result.verdict == LevelAnalysis::Verdict::TooNarrow) {
+            ++tooNarrow;
+            std::cout << "seed " << seed << ": a path exists but the player does not fit through it" << std::endl;
+        }
+        else {
+            ++blocked;
+            std::cout << "seed " << seed << ": no path to the goal" << std::endl;
+        }
+    }
+    std::sort(pathLengths.begin(), pathLengths.end());
+    std::cout << "level " << options.level << ", seeds " << options.seed << " to " << options.seed + static_cast<uint32_t>(options.validate - 1) << ": "
+        << pathLengths.size() << " traversable, " << tooNarrow << " too narrow, " << blocked << " blocked";
+    if (!pathLengths.empty()) {
+        std::cout << "; shortest path " << pathLengths.front() << "/" << pathLengths[pathLengths.size() / 2] << "/" << pathLengths.back()
+            << " steps (min/median/max)";
+    }
+    std::cout << ", " << static_cast<double>(chokepoints) / options.validate << " chokepoints per level; "
+        << static_cast<long long>(seconds > 0.0 ? options.validate * 60.0 / seconds : 0.0) << " levels/minute on "
+        << jobSystem().numThreads() << " threads" << std::endl;
+    return tooNarrow + blocked > 0 ? 2 : 0;
+}
+
+// Plays a recorded session back headless, checking every tick against the recorded state hash.
+// With seekTick >= 0 playback starts there, from the nearest keyframe. Returns 2 on a desync.
+// With reportFile the time of every tick goes into a FrameStats report, to compare builds with.
+int runReplay(const char* path, int seekTick, const char* reportFile)
+{
+    Replay replay;
+    std::string error;
+    if (!replay.load(path, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    NullAudio audio;
+    LevelGameState::setControlFlags(replay.controls);
+    LevelGameState gameState(audio, replay.level, replay.seed);
+    ReplayPlayer<LevelGameState> player(gameState, replay, 1.0f / 60.0f);
+
+    const auto seekStart = std::chrono::steady_clock::now();
+    if (!player.seek(std::max(0, seekTick)) && player.desyncTick < 0) {
+        std::cerr << path << ": keyframe does not match this build" << std::endl;
+        return 1;
+    }
+    const auto playStart = std::chrono::steady_clock::now();
+    const int firstTick = player.currentTick();
+    std::unique_ptr<FrameStats> stats(reportFile ? new FrameStats() : nullptr);
+    while (!player.finished()) {
+        frameArena().reset();
+        const auto stepStart = std::chrono::steady_clock::now();
+        const int tick = player.currentTick();
+        player.step();
+        if (stats) {
+            char section[24];
+            stats->record(levelSection(gameState, replay.level, section), tick, tick, -1, microsSince(stepStart), -1);
+        }
+    }
+    const auto playEnd = std::chrono::steady_clock::now();
+
+    const double seekMs = std::chrono::duration<double, std::milli>(playStart - seekStart).count();
+    const double playMs = std::chrono::duration<double, std::milli>(playEnd - playStart).count();
+    const int ticks = player.currentTick() - firstTick;
+    std::cout << path << ": level " << replay.level << " seed " << replay.seed << ", " << replay.numTicks() << " ticks";
+    if (seekTick >= 0)
+        std::cout << ", seek to " << firstTick << " in " << seekMs << " ms (keyframe " << replay.keyframeAtOrBefore(firstTick).tick << ")";
+    std::cout << ", played " << ticks << " ticks in " << playMs << " ms ("
+        << static_cast<long long>(playMs > 0.0 ? ticks * 1000.0 / 60.0 / playMs : 0.0) << "x real time), ";
+    if (player.desyncTick >= 0) {
+        std::cout << "desync at tick " << player.desyncTick << std::endl;
+        return 2;
+    }
+    std::cout << "in sync" << std::endl;
+    if (stats) {
+        std::string heading = std::string("replay ") + path + ", level " + std::to_string(replay.level) + " seed " + std::to_string(replay.seed)
+            + ", sim time per tick, headless";
+        if (!stats->save(reportFile, heading, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void saveReplay(const Replay& replay, const char* path)
+{
+    std::string error;
+    if (!replay.save(path, error))
+        std::cerr << error << std::endl;
+}
+
+// bench/ builds this file with PIXIN_NO_MAIN defined to time the pieces above
+#if !defined(PIXIN_NO_MAIN)
+
+static void saveTrace(const char* path)
+{
+    std::string error;
+    if (!writeChromeTrace(path, error))
+        std::cerr << error << std::endl;
+}
+
+// The windowed game, one frame per call to frame(): natively from a plain loop, on the web from the
+// browser's frame callback (emscripten_set_main_loop_arg), so a frame must never block. The title
+// screen runs in the frame. A level is simulated on its own thread at ticksPerSecond (on the web,
+// within the frame), and what the window shows is a second game (levelView) that shares the level's
+// shape with it and takes the newest tick every frame. A new level is generated a few steps a frame, generationBudgetMicros at a time, with
+// the title screen still up. Sim time in the report is whatever generated or stepped the game during
+// a frame, on either thread. The scene is drawn at the scale DynamicResolution picks to hold the frame
+// rate (fps, or 60 with vsync), and every change of scale is logged. Memory is checked on arriving
+// at the title screen and at every level start (memoryCheckpoints()), and written out at the end.
+class WindowSession
+{
+public:
+    static const int64_t generationBudgetMicros = 8000;
+
+    WindowSession(int ticksPerSecond, int fps, const char* reportFile, const char* traceFile)
+        : ticksPerSecond(ticksPerSecond)
+        , fps(fps)
+        , simTimeSeconds(1.0f / static_cast<float>(std::max(1, ticksPerSecond)))
+        , reportFile(reportFile)
+        , traceFile(traceFile)
+        , titleInput{ 0, 0 }
+        , titleSeconds(0.0f)
+        , nextGenerationStep(0)
+        , levelView(nullptr)
+        , inTitleScreen(true)
+        , level(0)
+        , stats(new FrameStats())
+        , levelSimMicros(0)
+        , frames(0)
+        , frameStart(std::chrono::steady_clock::now())
+        , resolution(1000000 / (fps > 0 ? fps : 60))
+        , gameState(new TitleScreenGameState(audio))
+    {
+        checkMemory("title");
+    }
+
+    // the replay of a level left unfinished, the frame report and the trace
+    ~WindowSession() {
+        simThread.reset();
+        {
+            std::ofstream file(memoryReportFile);
+            writeMemoryReport(file, memorySnapshot());
+            for (const auto& warning : memoryCheckpoints().allWarnings()) {
+                file << "possible leak: " << warning << "\n";
+            }
+            if (!file)
+                std::cerr << "cannot write " << memoryReportFile << std::endl;
+        }
+        windowCanvas().releaseScene();
+        if (recorder)
+            saveReplay(replay, replayFile);
+        {
+            std::string error;
+            const std::string heading = "session of " + std::to_string(frames) + " frames, " + std::to_string(ticksPerSecond) + " ticks/s, "
+                + (fps > 0 ? std::to_string(fps) + " fps" : std::string("vsync"));
+            if (!stats->save(reportFile ? reportFile : "last_report.txt", heading, error))
+                std::cerr << error << std::endl;
+        }
+        if (traceFile)
+            saveTrace(traceFile);
+    }
+
+    WindowSession(const WindowSession&) = delete;
+    WindowSession& operator=(const WindowSession&) = delete;
 
+    static void frameCallback(void* session) { static_cast<WindowSession*>(session)->frame(); }
 
-int main(void)
+    void frame() {
+        int64_t simMicros = 0;
+        if (!generationSteps.empty()) {
+            const auto generateStart = std::chrono::steady_clock::now();
+            generate();
+            simMicros += microsSince(generateStart);
+        }
+        else if (gameState->finished) {
+            const auto switchStart = std::chrono::steady_clock::now();
+            if (inTitleScreen)
+                chooseLevel();
+            else
+                endLevel();
+            simMicros += microsSince(switchStart);
+        }
+        const long long allocationsAtFrameStart = gHeapAllocations.load(std::memory_order_relaxed);
+        frameArena().reset();
+        profileFrame();
+        const InputFrame input = keyboard.next();
+        if (input.hit(BUTTON_PROFILER))
+            toggleProfileOverlay();
+        if (input.hit(BUTTON_TRACE))
+            saveTrace("pixin_trace.json");
+        if (input.hit(BUTTON_MEMORY))
+            gMemoryOverlay = !gMemoryOverlay;
+        if (simThread) {
+            simThread->submit(input);
+            simThread->present(*levelView);
+            simAudio.flush(audio);
+        }
+        else {
+            // the title screen on the same fixed tick as a level, whatever the display's refresh rate;
+            // presses wait for the next tick rather than be lost on a frame that runs none
+            const auto simStart = std::chrono::steady_clock::now();
+            titleInput.held = input.held;
+            titleInput.pressed |= input.pressed;
+            titleSeconds += GetFrameTime();
+            for (int ii = 0; ii < maxTitleCatchUp && titleSeconds >= simTimeSeconds; ++ii) {
+                gameState->Sim(simTimeSeconds, titleInput);
+                titleInput.pressed = 0;
+                titleSeconds -= simTimeSeconds;
+            }
+            titleSeconds = std::min(titleSeconds, simTimeSeconds); // skip ahead after a stall
+            simMicros += microsSince(simStart);
+        }
+        audio.update(GetFrameTime());
+        const auto renderStart = std::chrono::steady_clock::now();
+        gameState->Render();
+        const int64_t renderMicros = microsSince(renderStart);
+        gFrameAllocations = gHeapAllocations.load(std::memory_order_relaxed) - allocationsAtFrameStart;
+
+        simMicros += levelSimMicros.exchange(0, std::memory_order_relaxed);
+        const int64_t frameMicros = microsSince(frameStart);
+        char section[24];
+        stats->record(levelView ? levelSection(*levelView, level, section) : "title", frames++, levelView ? levelView->simTick : -1,
+            frameMicros, simMicros, renderMicros);
+        frameStart = std::chrono::steady_clock::now();
+
+        const float previousScale = resolution.scale();
+        if (resolution.update(frameMicros, windowCanvas().presentMicros())) {
+            windowCanvas().setSceneScale(resolution.scale());
+            TraceLog(LOG_INFO, "PIXIN: scene scale %.2f -> %.2f at frame %d (%dx%d window, %.1f ms a frame, %.1f ms of it on the CPU)",
+                previousScale, resolution.scale(), frames, canvas().width(), canvas().height(),
+                resolution.recentFrameMicros() / 1000.0, resolution.recentCpuMicros() / 1000.0);
+        }
+    }
+
+private:
+    // the title screen is done: start generating the level it chose
+    void chooseLevel() {
+        auto title = dynamic_cast<TitleScreenGameState*>(gameState.get());
+        if (title) {
+            level = title->currLevel;
+            title->generated = 0.0f;
+        }
+        const uint32_t seed = static_cast<uint32_t>(std::chrono::system_clock::now().time_since_epoch().count());
+        levelState.reset(new LevelGameState(simAudio, level, seed, generationSteps));
+        nextGenerationStep = 0;
+        replay = Replay();
+        replay.level = level;
+        replay.seed = seed;
+    }
+
+    // steps of the level being generated, at least one, until the budget is spent
+    void generate() {
+        PROFILE_SCOPE("generate steps");
+        const auto start = std::chrono::steady_clock::now();
+        do {
+            generationSteps[nextGenerationStep++]();
+        } while (nextGenerationStep < generationSteps.size() && microsSince(start) < generationBudgetMicros);
+        if (nextGenerationStep < generationSteps.size()) {
+            if (auto title = dynamic_cast<TitleScreenGameState*>(gameState.get()))
+                title->generated = static_cast<float>(nextGenerationStep) / static_cast<float>(generationSteps.size());
+            return;
+        }
+        generationSteps.clear();
+        startLevel();
+    }
+
+    void startLevel() {
+        levelView = new LevelGameState(audio, *levelState);
+        gameState.reset(levelView);
+        {
+            MemoryTagScope tag(MemoryTag::Replay);
+            replay.controls = LevelGameState::controlFlags();
+            replay.inputs.reserve(60 * 60 * 10);
+            replay.hashes.reserve(60 * 60 * 10);
+            recorder.reset(new ReplayRecorder<LevelGameState>(*levelState, replay));
+            rewind.reset(new RewindBuffer<LevelGameState>(*levelState));
+        }
+        simThread.reset(new SimThread<LevelGameState>(*levelState, ticksPerSecond, [this](const InputFrame& input) {
+            // what a tick allocates is history: the replay and the rewind buffer
+            MemoryTagScope tag(MemoryTag::Replay);
+            const auto tickStart = std::chrono::steady_clock::now();
+            stepLevel(*levelState, simTimeSeconds, input, *rewind, recorder.get());
+            levelSimMicros.fetch_add(microsSince(tickStart), std::memory_order_relaxed);
+        }));
+        inTitleScreen = false;
+        checkMemory("level start");
+    }
+
+    void endLevel() {
+        simThread.reset();
+        saveReplay(replay, replayFile);
+        recorder.reset();
+        rewind.reset();
+        levelState.reset();
+        levelView = nullptr;
+        gameState.reset(new TitleScreenGameState(audio));
+        inTitleScreen = true;
+        checkMemory("title");
+    }
+
+    static void checkMemory(const char* state) {
+        for (const auto& warning : memoryCheckpoints().arrive(state)) {
+            TraceLog(LOG_WARNING, "PIXIN: possible leak: %s", warning.c_str());
+        }
+    }
+
+    static const int maxTitleCatchUp = 5; // title ticks run in one frame after a stall
+
+    const char* const replayFile = "last.replay";
+    const char* const memoryReportFile = "last_memory.txt";
+    const int ticksPerSecond;
+    const int fps;
+    const float simTimeSeconds;
+    const char* const reportFile;
+    const char* const traceFile;
+    RaylibAudio audio;
+    AudioQueue simAudio; // sounds made on the sim thread, played from here
+    KeyboardInput keyboard;
+    InputFrame titleInput; // for the next title screen tick
+    float titleSeconds;    // not yet simulated on the title screen
+    Replay replay; // every level played is recorded, and saved when it ends
+    std::unique_ptr< ReplayRecorder<LevelGameState> > recorder;
+    std::unique_ptr< RewindBuffer<LevelGameState> > rewind;
+    std::unique_ptr<LevelGameState> levelState;
+    std::vector<LevelGeometry::GenerationStep> generationSteps; // of levelState's level, while it is generated
+    size_t nextGenerationStep;
+    std::unique_ptr< SimThread<LevelGameState> > simThread;
+    LevelGameState* levelView;
+    bool inTitleScreen;
+    int level;
+    std::unique_ptr<FrameStats> stats; // written when the session ends
+    std::atomic<int64_t> levelSimMicros; // sim thread ticks since the last frame
+    int frames;
+    std::chrono::steady_clock::time_point frameStart;
+    DynamicResolution resolution;
+    std::unique_ptr<GameState> gameState;
+};
+
+// Usage: pixin [--headless [--level N] [--seed N] [--controls N] [--ticks N] [--input FILE] [--record FILE] [--nokill] [--batch N]
+//                         [--screenshot FILE] [--title] [--validate N]]
+//              [--replay FILE [--seek TICK]] [--fps N] [--tick-rate N] [--window WxH] [--trace FILE] [--report FILE]
+int main(int argc, char** argv)
 {
+    bool headless = false;
+    HeadlessOptions options;
+    const char* replayFile = nullptr;
+    int seekTick = -1;
+    int fps = 0;            // frames drawn per second, 0 to follow the display
+    int ticksPerSecond = 60; // the game's speed; its rules count ticks
+    int windowWidth = screenWidth;
+    int windowHeight = screenHeight;
+    const char* traceFile = nullptr; // Chrome trace written at exit; needs PIXIN_PROFILE
+    const char* reportFile = nullptr; // frame time report; a replay only writes one if asked
+    for (int ii = 1; ii < argc; ++ii) {
+        const std::string arg = argv[ii];
+        const bool hasValue = ii + 1 < argc;
+        if (arg == "--headless") headless = true;
+        else if (arg == "--level" && hasValue) options.level = atoi(argv[++ii]);
+        else if (arg == "--seed" && hasValue) options.seed = static_cast<uint32_t>(strtoul(argv[++ii], nullptr, 10));
+        else if (arg == "--controls" && hasValue) options.controls = static_cast<uint32_t>(atoi(argv[++ii]));
+        else if (arg == "--ticks" && hasValue) options.maxTicks = atoi(argv[++ii]);
+        else if (arg == "--input" && hasValue) options.inputFile = argv[++ii];
+        else if (arg == "--record" && hasValue) options.recordFile = argv[++ii];
+        else if (arg == "--nokill") options.noKill = true;
+        else if (arg == "--batch" && hasValue) options.batch = atoi(argv[++ii]);
+        else if (arg == "--screenshot" && hasValue) options.screenshotFile = argv[++ii];
+        else if (arg == "--title") options.title = true;
+        else if (arg == "--validate" && hasValue) options.validate = atoi(argv[++ii]);
+        else if (arg == "--replay" && hasValue) replayFile = argv[++ii];
+        else if (arg == "--seek" && hasValue) seekTick = atoi(argv[++ii]);
+        else if (arg == "--fps" && hasValue) fps = atoi(argv[++ii]);
+        else if (arg == "--tick-rate" && hasValue) ticksPerSecond = atoi(argv[++ii]);
+        else if (arg == "--window" && hasValue && sscanf(argv[ii + 1], "%dx%d", &windowWidth, &windowHeight) == 2) ++ii;
+        else if (arg == "--trace" && hasValue) traceFile = argv[++ii];
+        else if (arg == "--report" && hasValue) reportFile = argv[++ii];
+        else {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+    PROFILE_THREAD("main");
+    if (replayFile || headless) {
+        const int result = replayFile ? runReplay(replayFile, seekTick, reportFile)
+            : options.batch > 0 ? runBatch(options)
+            : options.validate > 0 ? runValidate(options)
+            : runHeadless(options);
+        if (traceFile)
+            saveTrace(traceFile);
+        return result;
+    }
+
     // Initialization
     //--------------------------------------------------------------------------------------
-    const int screenWidth = 800;
-    const int screenHeight = 600;
-    const int fps = 60;
-    float simTimeSeconds = 1.0f / static_cast<float>(fps);
-
-    InitWindow(screenWidth, screenHeight, "Ludumdare 48");
+    if (fps <= 0)
+        SetConfigFlags(FLAG_VSYNC_HINT);
+    InitWindow(windowWidth, windowHeight, "Ludumdare 48");
     InitAudioDevice();
     SetTargetFPS(fps);
 
+#if !defined(__EMSCRIPTEN__)
     while (!IsAudioDeviceReady()) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+#endif
     SetMasterVolume(0.5);
 
     // Main game loop
+#if defined(__EMSCRIPTEN__)
+    // The browser calls the session back every frame for as long as the page is open, and main()
+    // returns without running anything after this, so the session is never destroyed.
+    emscripten_set_main_loop_arg(&WindowSession::frameCallback, new WindowSession(ticksPerSecond, fps, reportFile, traceFile), 0, 1);
+#else
     {
-        bool inTitleScreen = true;
-        std::unique_ptr<GameState> gameState(new TitleScreenGameState);
+        WindowSession session(ticksPerSecond, fps, reportFile, traceFile);
         while (!WindowShouldClose())    // Detect window close button or ESC key
         {
-            if (gameState->finished) {
-                if (inTitleScreen) {
-                    int level = 0;
-                    {
-                        auto gs = dynamic_cast<TitleScreenGameState*>(gameState.get());
-                        if (gs) level = gs->currLevel;
-                    }
-                    gameState.reset(new LevelGameState(level));
-                }
-                else {
-                    gameState.reset(new TitleScreenGameState);
-                }
-                inTitleScreen = !inTitleScreen;
-            }
-            gameState->Sim(simTimeSeconds);
-            gameState->Render();
+            session.frame();
         }
     }
 
     CloseWindow();        // Close window and OpenGL context
     CloseAudioDevice();
+#endif
     return 0;
 }
 
-
+#endif // !PIXIN_NO_MAIN